@@ -30,6 +30,7 @@
 #include "qemu/atomic.h"
 #include "qemu/timer.h"
 #include "qemu/rcu.h"
+#include "qemu/stats64.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
@@ -45,6 +46,7 @@
 #include "tb-hash.h"
 #include "tb-context.h"
 #include "internal.h"
+#include "tb-stats.h"
 
 /* -icount align implementation. */
 
@@ -218,9 +220,9 @@ static bool tb_lookup_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
-                                          target_ulong cs_base, uint32_t flags,
-                                          uint32_t cflags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags,
+                                   uint32_t cflags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -242,6 +244,134 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+CPUJumpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(CPUJumpCache) +
+                   (sizeof(CPUJumpCacheEntry) << bits));
+    jc->bits = bits;
+    jc->mask = (1u << bits) - 1;
+    return jc;
+}
+
+/*
+ * Resize the jump cache of @cpu according to its miss rate since the last
+ * call, in the same spirit as tlb_mmu_resize_locked for the softmmu TLB.
+ *
+ * Grow the cache if more than 1/16 of the lookups missed, i.e. went to
+ * the QHT.  Shrink it back towards TB_JMP_CACHE_BITS if fewer than 1/256
+ * of the lookups missed: the whole cache is cleared on every TLB flush,
+ * so an oversized cache is not free.
+ *
+ * Returns the jump cache to use from now on.
+ */
+static CPUJumpCache *tb_jmp_cache_resize(CPUState *cpu, CPUJumpCache *jc)
+{
+    uint64_t lookups = jc->hits + jc->victim_hits + jc->misses;
+    uint64_t window = lookups - jc->window_lookups;
+    uint64_t misses = jc->misses - jc->window_misses;
+    unsigned int bits = jc->bits;
+    CPUJumpCache *new_jc;
+    unsigned int i;
+
+    jc->window_lookups = lookups;
+    jc->window_misses = jc->misses;
+
+    if (misses * 16 > window && bits < TB_JMP_CACHE_MAX_BITS) {
+        bits++;
+    } else if (misses * 256 < window && bits > TB_JMP_CACHE_BITS) {
+        bits--;
+    } else {
+        return jc;
+    }
+
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->victim_next = jc->victim_next;
+    new_jc->hits = jc->hits;
+    new_jc->victim_hits = jc->victim_hits;
+    new_jc->misses = jc->misses;
+    new_jc->window_lookups = jc->window_lookups;
+    new_jc->window_misses = jc->window_misses;
+    new_jc->ibtc_misses = jc->ibtc_misses;
+    new_jc->ras_misses = jc->ras_misses;
+    new_jc->ras_top = jc->ras_top;
+    memcpy(new_jc->ibtc, jc->ibtc, sizeof(jc->ibtc));
+    memcpy(new_jc->ras, jc->ras, sizeof(jc->ras));
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        TranslationBlock *tb = tb_jmp_entry_get_tb(&jc->victim[i]);
+        if (tb) {
+            tb_jmp_entry_set(&new_jc->victim[i], tb,
+                             tb_jmp_entry_get_pc(&jc->victim[i], tb));
+        }
+    }
+    for (i = 0; i <= jc->mask; i++) {
+        TranslationBlock *tb = tb_jmp_entry_get_tb(&jc->array[i]);
+        if (tb && !(tb_cflags(tb) & CF_INVALID)) {
+            target_ulong pc = tb_jmp_entry_get_pc(&jc->array[i], tb);
+            uint32_t hash = tb_jmp_cache_hash_func(new_jc, pc);
+
+            tb_jmp_entry_set(&new_jc->array[hash], tb, pc);
+        }
+    }
+
+    /*
+     * Other threads may clear entries of the old cache until they see
+     * the new one.  Such an entry may have been copied above, but its
+     * TB is marked CF_INVALID and will not match any lookup.
+     */
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+    return new_jc;
+}
+
+static TranslationBlock * __attribute__((noinline))
+tb_lookup_slow(CPUState *cpu, CPUJumpCache *jc, target_ulong pc,
+               target_ulong cs_base, uint32_t flags, uint32_t cflags)
+{
+    TranslationBlock *tb;
+    uint32_t hash;
+    int i;
+
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        CPUJumpCacheEntry *e = &jc->victim[i];
+
+        tb = tb_jmp_entry_get_tb(e);
+        if (tb &&
+            tb_jmp_entry_get_pc(e, tb) == pc &&
+            tb->cs_base == cs_base &&
+            tb->flags == flags &&
+            tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+            tb_cflags(tb) == cflags) {
+            jc->victim_hits++;
+            /* Swap the entry with the one in the direct-mapped cache. */
+            qatomic_set(&e->tb, NULL);
+            tb_jmp_cache_set(jc, tb_jmp_cache_hash_func(jc, pc), tb, pc);
+            return tb;
+        }
+    }
+
+    jc->misses++;
+    if (jc->misses - jc->window_misses > 64 &&
+        jc->hits + jc->victim_hits + jc->misses - jc->window_lookups >
+        4 * (jc->mask + 1)) {
+        jc = tb_jmp_cache_resize(cpu, jc);
+    }
+
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+    if (tb == NULL) {
+        return NULL;
+    }
+    /* A TB is in no jump cache before its first lookup. */
+    if (unlikely(qatomic_read(&tb->prefetched)) &&
+        qatomic_xchg(&tb->prefetched, false)) {
+        qatomic_inc(&tb_ctx.tb_prefetch_hit_count);
+    }
+    hash = tb_jmp_cache_hash_func(jc, pc);
+    tb_jmp_cache_set(jc, hash, tb, pc);
+    return tb;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
@@ -254,8 +384,8 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, pc);
     tb = tb_jmp_cache_get_tb(jc, hash);
 
     if (likely(tb &&
@@ -264,14 +394,10 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                tb->flags == flags &&
                tb->trace_vcpu_dstate == *cpu->trace_dstate &&
                tb_cflags(tb) == cflags)) {
+        jc->hits++;
         return tb;
     }
-    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
-    if (tb == NULL) {
-        return NULL;
-    }
-    tb_jmp_cache_set(jc, hash, tb, pc);
-    return tb;
+    return tb_lookup_slow(cpu, jc, pc, cs_base, flags, cflags);
 }
 
 static void log_cpu_exec(target_ulong pc, CPUState *cpu,
@@ -377,6 +503,42 @@ static inline bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
         check_for_breakpoints_slow(cpu, pc, cflags);
 }
 
+/*
+ * Look for an existing TB matching the current cpu state, and store the
+ * current pc in @pc.  Return NULL if none is found, or if the TB must be
+ * entered from the main loop.
+ */
+static TranslationBlock *lookup_tb_ptr(CPUArchState *env, target_ulong *pc)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *tb;
+    target_ulong cs_base;
+    uint32_t flags, cflags;
+
+    cpu_get_tb_cpu_state(env, pc, &cs_base, &flags);
+
+    cflags = curr_cflags(cpu);
+    if (check_for_breakpoints(cpu, *pc, &cflags)) {
+        cpu_loop_exit(cpu);
+    }
+
+    tb = tb_lookup(cpu, *pc, cs_base, flags, cflags);
+    if (tb == NULL) {
+        return NULL;
+    }
+
+    /* Return to the main loop to count the execution of a cold TB. */
+    if (tb_is_cold(tb)) {
+        return NULL;
+    }
+
+    if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
+        log_cpu_exec(*pc, cpu, tb);
+    }
+
+    return tb;
+}
+
 /**
  * helper_lookup_tb_ptr: quick check for next tb
  * @env: current cpu state
@@ -387,27 +549,64 @@ static inline bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
  */
 const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 {
-    CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
-    target_ulong cs_base, pc;
-    uint32_t flags, cflags;
+    target_ulong pc;
 
-    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    tb = lookup_tb_ptr(env, &pc);
+    return tb ? tb->tc.ptr : tcg_code_gen_epilogue;
+}
 
-    cflags = curr_cflags(cpu);
-    if (check_for_breakpoints(cpu, pc, &cflags)) {
-        cpu_loop_exit(cpu);
-    }
+/**
+ * helper_lookup_tb_ptr_ibtc: look up the target of an indirect branch
+ * @env: current cpu state
+ * @idx: index of the branch in the indirect branch target cache
+ *
+ * As helper_lookup_tb_ptr, for a branch whose cached target was not the
+ * current pc.  Cache the TB that was found as the next prediction.
+ */
+const void *HELPER(lookup_tb_ptr_ibtc)(CPUArchState *env, uint32_t idx)
+{
+    CPUJumpCache *jc = env_cpu(env)->tb_jmp_cache;
+    TranslationBlock *tb;
+    target_ulong pc;
 
-    tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
+    jc->ibtc_misses++;
+    tb = lookup_tb_ptr(env, &pc);
     if (tb == NULL) {
         return tcg_code_gen_epilogue;
     }
+    /* The cache may have been resized, reload it. */
+    jc = env_cpu(env)->tb_jmp_cache;
+    jc->ibtc[idx].pc = pc;
+    qatomic_set(&jc->ibtc[idx].tb, tb);
+    return tb->tc.ptr;
+}
 
-    if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
-        log_cpu_exec(pc, cpu, tb);
-    }
+/**
+ * helper_lookup_tb_ptr_ret: look up the target of a function return
+ * @env: current cpu state
+ *
+ * As helper_lookup_tb_ptr, for a return whose target was not predicted
+ * by the return address stack.  If the entry just popped has the right
+ * return address, remember the TB that was found in it.
+ */
+const void *HELPER(lookup_tb_ptr_ret)(CPUArchState *env)
+{
+    CPUJumpCache *jc = env_cpu(env)->tb_jmp_cache;
+    CPUBranchCacheEntry *e;
+    TranslationBlock *tb;
+    target_ulong pc;
 
+    jc->ras_misses++;
+    tb = lookup_tb_ptr(env, &pc);
+    if (tb == NULL) {
+        return tcg_code_gen_epilogue;
+    }
+    jc = env_cpu(env)->tb_jmp_cache;
+    e = &jc->ras[(jc->ras_top + 1) & (TB_JMP_RAS_SIZE - 1)];
+    if (e->pc == pc) {
+        qatomic_set(&e->tb, tb);
+    }
     return tb->tc.ptr;
 }
 
@@ -506,20 +705,27 @@ static void cpu_exec_exit(CPUState *cpu)
     QEMU_PLUGIN_ASSERT(cpu->plugin_mem_cbs == NULL);
 }
 
+/* Number and total duration of the exclusive sections of atomic steps */
+static Stat64 exclusive_steps;
+static Stat64 exclusive_ns;
+
+void tcg_exclusive_stats(uint64_t *count, uint64_t *ns)
+{
+    *count = stat64_get(&exclusive_steps);
+    *ns = stat64_get(&exclusive_ns);
+}
+
 void cpu_exec_step_atomic(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb;
     target_ulong cs_base, pc;
     uint32_t flags, cflags;
+    unsigned flush_count, evict_count;
+    volatile int64_t start = 0;
     int tb_exit;
 
     if (sigsetjmp(cpu->jmp_env, 0) == 0) {
-        start_exclusive();
-        g_assert(cpu == current_cpu);
-        g_assert(!cpu->running);
-        cpu->running = true;
-
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
 
         cflags = curr_cflags(cpu);
@@ -534,12 +740,40 @@ void cpu_exec_step_atomic(CPUState *cpu)
          * Any breakpoint for this insn will have been recognized earlier.
          */
 
+        /*
+         * Find or translate the TB while the other cpus still run, so
+         * that they are only stopped for its execution.  Code buffer
+         * flushes and evictions are done with all cpus stopped, so the
+         * TB remains valid until start_exclusive unless one of them
+         * happened in between.
+         */
+        cpu_exec_start(cpu);
         tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
             mmap_lock();
             tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
             mmap_unlock();
         }
+        flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+        evict_count = qatomic_read(&tb_ctx.tb_evict_count);
+        cpu_exec_end(cpu);
+
+        start_exclusive();
+        start = get_clock();
+        g_assert(cpu == current_cpu);
+        g_assert(!cpu->running);
+        cpu->running = true;
+
+        if (tb_ctx.tb_flush_count != flush_count ||
+            tb_ctx.tb_evict_count != evict_count ||
+            (tb_cflags(tb) & CF_INVALID)) {
+            tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
+            if (tb == NULL) {
+                mmap_lock();
+                tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                mmap_unlock();
+            }
+        }
 
         cpu_exec_enter(cpu);
         /* execute the generated code */
@@ -556,16 +790,21 @@ void cpu_exec_step_atomic(CPUState *cpu)
         if (qemu_mutex_iothread_locked()) {
             qemu_mutex_unlock_iothread();
         }
+        tcg_ctx->gen_speculative = false;
         assert_no_pages_locked();
         qemu_plugin_disable_mem_helpers(cpu);
     }
 
     /*
-     * As we start the exclusive region before codegen we must still
-     * be in the region if we longjump out of either the codegen or
-     * the execution.
+     * We may have longjumped out of the codegen before entering the
+     * exclusive region, or out of the codegen or execution within it.
      */
-    g_assert(cpu_in_exclusive_context(cpu));
+    if (!cpu_in_exclusive_context(cpu)) {
+        cpu_exec_end(cpu);
+        return;
+    }
+    stat64_add(&exclusive_steps, 1);
+    stat64_add(&exclusive_ns, get_clock() - start);
     cpu->running = false;
     end_exclusive();
 }
@@ -624,6 +863,30 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     return;
 }
 
+/*
+ * Count an execution of the cold TB @tb, and retranslate it with all
+ * optimizations once it has been executed tcg_tier_threshold times.
+ */
+static inline TranslationBlock *tb_tier_count(CPUState *cpu,
+                                              TranslationBlock *tb,
+                                              target_ulong pc)
+{
+    CPUJumpCache *jc;
+
+    if (likely(!tb_is_cold(tb)) ||
+        qatomic_dec_fetch(&tb->tier_count) != 0) {
+        return tb;
+    }
+
+    mmap_lock();
+    tb = tb_tier_up(cpu, tb, pc);
+    mmap_unlock();
+
+    jc = cpu->tb_jmp_cache;
+    tb_jmp_cache_set(jc, tb_jmp_cache_hash_func(jc, pc), tb, pc);
+    return tb;
+}
+
 static inline bool cpu_handle_halt(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
@@ -949,7 +1212,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
-                uint32_t h;
+                CPUJumpCache *jc;
 
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
@@ -958,8 +1221,10 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
-                tb_jmp_cache_set(cpu->tb_jmp_cache, h, tb, pc);
+                jc = cpu->tb_jmp_cache;
+                tb_jmp_cache_set(jc, tb_jmp_cache_hash_func(jc, pc), tb, pc);
+            } else {
+                tb = tb_tier_count(cpu, tb, pc);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -973,8 +1238,11 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 last_tb = NULL;
             }
 #endif
-            /* See if we can patch the calling TB. */
-            if (last_tb) {
+            /*
+             * See if we can patch the calling TB.  Cold TBs are only
+             * entered from this loop, which counts their executions.
+             */
+            if (last_tb && !tb_is_cold(tb)) {
                 tb_add_jump(last_tb, tb_exit, tb);
             }
 
@@ -1005,6 +1273,8 @@ static int cpu_exec_setjmp(CPUState *cpu, SyncClocks *sc)
         if (qemu_mutex_iothread_locked()) {
             qemu_mutex_unlock_iothread();
         }
+        /* A translation ahead of execution may have been interrupted. */
+        tcg_ctx->gen_speculative = false;
         qemu_plugin_disable_mem_helpers(cpu);
 
         assert_no_pages_locked();
@@ -1054,7 +1324,7 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -1109,6 +1379,33 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_tb_stats(bool has_max, int64_t max,
+                                        bool has_sort_by,
+                                        TbStatsSortBy sort_by,
+                                        Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return NULL;
+    }
+    if (!tcg_tb_stats) {
+        error_setg(errp, "TB statistics are not enabled, "
+                   "use -accel tcg,tb-stats=on");
+        return NULL;
+    }
+    if (has_max && max < 0) {
+        error_setg(errp, "Parameter 'max' must not be negative");
+        return NULL;
+    }
+
+    tb_stats_dump(buf, has_max ? max : 10,
+                  has_sort_by ? sort_by : TB_STATS_SORT_BY_EXECUTIONS);
+
+    return human_readable_text_from_str(buf);
+}
+
 HumanReadableText *qmp_x_query_opcount(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
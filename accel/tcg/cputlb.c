@@ -107,10 +107,15 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
+    /* The victim and branch caches are not indexed by page. */
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i].tb, NULL);
+    }
+    tb_jmp_cache_clear_branches(jc);
 }
 
 /**
@@ -231,8 +236,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    desc->n_large_pages = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -270,6 +274,92 @@ static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
     env_tlb(env)->d[mmu_idx].n_used_entries--;
 }
 
+/*
+ * Translation contexts saved by tlb_switch_context.  A switch swaps the
+ * tables of every mmu_idx with those of a saved context, so that saving
+ * and restoring a context copies no entries.  When no context matches,
+ * a slot that is not valid, or else the least recently used one, is
+ * flushed and becomes the new TLB.  Slots are stamped from a counter each
+ * time they receive the outgoing context.
+ *
+ * A slot that is not valid may still hold stale entries in the mmu_idx
+ * of its dirty mask; they are flushed before the slot is reused.
+ */
+#define CPU_TLB_SAVED_CONTEXTS 4
+
+typedef struct CPUTLBContext {
+    bool valid;
+    uint16_t dirty;
+    uint64_t tag;
+    uint64_t stamp;
+    CPUTLBDesc d[NB_MMU_MODES];
+    CPUTLBDescFast f[NB_MMU_MODES];
+} CPUTLBContext;
+
+typedef struct CPUTLBSaved {
+    uint64_t clock;
+    CPUTLBContext ctx[CPU_TLB_SAVED_CONTEXTS];
+} CPUTLBSaved;
+
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} TLBFlushRangeData;
+
+/*
+ * Page and range flushes asked by other cpus are queued on the target
+ * cpu and drained by a single work item, so that a burst of flushes,
+ * as when a guest invalidates a large region page by page, costs the
+ * target one exit rather than one per page.  The source cpu of a synced
+ * flush queues its own part as well, drained by safe work.  Adjacent or
+ * overlapping ranges are merged, and once the queue is full the mmu_idx
+ * involved are flushed entirely instead.
+ */
+#define CPU_TLB_FLUSH_QUEUE_LEN 16
+
+typedef struct CPUTLBFlushQueue {
+    QemuSpin lock;
+    /* A work item is pending that will drain the queue. */
+    bool scheduled;
+    /* Likewise, as safe work for the synced flushes of the cpu itself. */
+    bool safe_scheduled;
+    /* The mmu_idx to flush entirely. */
+    uint16_t full_idxmap;
+    unsigned n;
+    TLBFlushRangeData range[CPU_TLB_FLUSH_QUEUE_LEN];
+} CPUTLBFlushQueue;
+
+static void tlb_flush_queue_push(CPUState *cpu, target_ulong addr,
+                                 target_ulong len, uint16_t idxmap,
+                                 unsigned bits, bool synced);
+
+/* Called with tlb_c.lock held */
+static void tlb_saved_flush_locked(CPUArchState *env, uint16_t idxmap)
+{
+    CPUTLBSaved *saved = env_tlb(env)->c.saved;
+    int i;
+
+    if (!saved) {
+        return;
+    }
+    for (i = 0; i < CPU_TLB_SAVED_CONTEXTS; i++) {
+        CPUTLBContext *ctx = &saved->ctx[i];
+        uint16_t work;
+
+        if (!ctx->valid) {
+            continue;
+        }
+        for (work = ctx->dirty & idxmap; work != 0; work &= work - 1) {
+            int mmu_idx = ctz32(work);
+            tlb_mmu_flush_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx]);
+        }
+        ctx->dirty &= ~idxmap;
+        ctx->valid = ctx->dirty != 0;
+    }
+}
+
 void tlb_init(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -277,6 +367,8 @@ void tlb_init(CPUState *cpu)
     int i;
 
     qemu_spin_init(&env_tlb(env)->c.lock);
+    env_tlb(env)->c.flush_queue = g_new0(CPUTLBFlushQueue, 1);
+    qemu_spin_init(&env_tlb(env)->c.flush_queue->lock);
 
     /* All tlbs are initialized flushed. */
     env_tlb(env)->c.dirty = 0;
@@ -292,6 +384,9 @@ void tlb_destroy(CPUState *cpu)
     int i;
 
     qemu_spin_destroy(&env_tlb(env)->c.lock);
+    qemu_spin_destroy(&env_tlb(env)->c.flush_queue->lock);
+    g_free(env_tlb(env)->c.flush_queue);
+    env_tlb(env)->c.flush_queue = NULL;
     for (i = 0; i < NB_MMU_MODES; i++) {
         CPUTLBDesc *desc = &env_tlb(env)->d[i];
         CPUTLBDescFast *fast = &env_tlb(env)->f[i];
@@ -299,6 +394,19 @@ void tlb_destroy(CPUState *cpu)
         g_free(fast->table);
         g_free(desc->fulltlb);
     }
+    if (env_tlb(env)->c.saved) {
+        CPUTLBSaved *saved = env_tlb(env)->c.saved;
+        int j;
+
+        for (j = 0; j < CPU_TLB_SAVED_CONTEXTS; j++) {
+            for (i = 0; i < NB_MMU_MODES; i++) {
+                g_free(saved->ctx[j].f[i].table);
+                g_free(saved->ctx[j].d[i].fulltlb);
+            }
+        }
+        g_free(saved);
+        env_tlb(env)->c.saved = NULL;
+    }
 }
 
 /* flush_all_helper: run fn across all cpus
@@ -320,10 +428,11 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
-void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                      size_t *plarge, size_t *pcoalesced)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, large = 0, coalesced = 0;
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -331,16 +440,24 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
         full += qatomic_read(&env_tlb(env)->c.full_flush_count);
         part += qatomic_read(&env_tlb(env)->c.part_flush_count);
         elide += qatomic_read(&env_tlb(env)->c.elide_flush_count);
+        large += qatomic_read(&env_tlb(env)->c.large_flush_count);
+        coalesced += qatomic_read(&env_tlb(env)->c.coalesced_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *plarge = large;
+    *pcoalesced = coalesced;
 }
 
-static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
+/*
+ * Flush @asked from the current TLB of @cpu and, if @saved, from the
+ * translation contexts saved by tlb_switch_context as well.
+ */
+static void tlb_flush_by_mmuidx_self(CPUState *cpu, uint16_t asked,
+                                     bool saved)
 {
     CPUArchState *env = cpu->env_ptr;
-    uint16_t asked = data.host_int;
     uint16_t all_dirty, work, to_clean;
     int64_t now = get_clock_realtime();
 
@@ -359,6 +476,9 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
         int mmu_idx = ctz32(work);
         tlb_flush_one_mmuidx_locked(env, mmu_idx, now);
     }
+    if (saved) {
+        tlb_saved_flush_locked(env, asked);
+    }
 
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
@@ -378,6 +498,11 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
     }
 }
 
+static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    tlb_flush_by_mmuidx_self(cpu, data.host_int, true);
+}
+
 void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap)
 {
     tlb_debug("mmu_idx: 0x%" PRIx16 "\n", idxmap);
@@ -425,6 +550,100 @@ void tlb_flush_all_cpus_synced(CPUState *src_cpu)
     tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, ALL_MMUIDX_BITS);
 }
 
+void tlb_switch_context(CPUState *cpu, uint64_t old_tag, uint64_t new_tag)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBSaved *saved;
+    CPUTLBContext *ctx = NULL;
+    uint16_t dirty, work;
+    int i;
+
+    assert_cpu_is_self(cpu);
+
+    if (old_tag == new_tag) {
+        return;
+    }
+
+    qemu_spin_lock(&tlb->c.lock);
+
+    saved = tlb->c.saved;
+    if (!saved) {
+        saved = tlb->c.saved = g_new0(CPUTLBSaved, 1);
+    }
+    for (i = 0; i < CPU_TLB_SAVED_CONTEXTS; i++) {
+        if (saved->ctx[i].valid && saved->ctx[i].tag == new_tag) {
+            ctx = &saved->ctx[i];
+            break;
+        }
+    }
+    if (!ctx) {
+        int64_t now = get_clock_realtime();
+
+        ctx = &saved->ctx[0];
+        for (i = 1; i < CPU_TLB_SAVED_CONTEXTS && ctx->valid; i++) {
+            if (!saved->ctx[i].valid || saved->ctx[i].stamp < ctx->stamp) {
+                ctx = &saved->ctx[i];
+            }
+        }
+        if (!ctx->f[0].table) {
+            for (i = 0; i < NB_MMU_MODES; i++) {
+                tlb_mmu_init(&ctx->d[i], &ctx->f[i], now);
+            }
+            ctx->dirty = 0;
+        }
+        for (work = ctx->dirty; work != 0; work &= work - 1) {
+            int mmu_idx = ctz32(work);
+            tlb_mmu_resize_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx], now);
+            tlb_mmu_flush_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx]);
+        }
+        ctx->dirty = 0;
+    }
+
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        CPUTLBDescFast f = tlb->f[i];
+        CPUTLBDesc d = tlb->d[i];
+
+        tlb->f[i] = ctx->f[i];
+        tlb->d[i] = ctx->d[i];
+        ctx->f[i] = f;
+        ctx->d[i] = d;
+    }
+    dirty = tlb->c.dirty;
+    tlb->c.dirty = ctx->dirty;
+    ctx->dirty = dirty;
+    ctx->tag = old_tag;
+    ctx->valid = dirty != 0;
+    ctx->stamp = ++saved->clock;
+
+    qemu_spin_unlock(&tlb->c.lock);
+
+    tcg_flush_jmp_cache(cpu);
+}
+
+void tlb_flush_context(CPUState *cpu, uint64_t cur_tag,
+                       uint64_t tag, uint64_t mask)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBSaved *saved;
+    int i;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    saved = env_tlb(env)->c.saved;
+    for (i = 0; saved && i < CPU_TLB_SAVED_CONTEXTS; i++) {
+        if ((saved->ctx[i].tag & mask) == tag) {
+            saved->ctx[i].valid = false;
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    if ((cur_tag & mask) == tag) {
+        tlb_flush_by_mmuidx_self(cpu, ALL_MMUIDX_BITS, false);
+    }
+}
+
 static bool tlb_hit_page_mask_anyprot(CPUTLBEntry *tlb_entry,
                                       target_ulong page, target_ulong mask)
 {
@@ -491,24 +710,108 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/*
+ * Flush every entry within large page region @i of @d, and forget it.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUTLBDesc *d, CPUTLBDescFast *f,
+                                        unsigned i)
+{
+    target_ulong addr = d->large_page[i].addr;
+    target_ulong mask = d->large_page[i].mask;
+    target_ulong n_pages = ~mask >> TARGET_PAGE_BITS;
+    size_t n_entries = tlb_n_entries(f);
+    size_t k;
+
+    tlb_debug("flush large page " TARGET_FMT_lx "/" TARGET_FMT_lx "\n",
+              addr, mask);
+
+    if (n_pages < n_entries) {
+        /* Probe each page of the region... */
+        for (target_ulong p = 0; p <= n_pages; p++) {
+            target_ulong page = addr + (p << TARGET_PAGE_BITS);
+            size_t index = (page >> TARGET_PAGE_BITS) & (n_entries - 1);
+
+            if (tlb_flush_entry_locked(&f->table[index], page)) {
+                d->n_used_entries--;
+            }
+        }
+    } else {
+        /* ... or each entry of the table, whichever is fewer. */
+        for (k = 0; k < n_entries; k++) {
+            if (tlb_flush_entry_mask_locked(&f->table[k], addr, mask)) {
+                d->n_used_entries--;
+            }
+        }
+    }
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        if (tlb_flush_entry_mask_locked(&d->vtable[k], addr, mask)) {
+            d->n_used_entries--;
+        }
+    }
+    d->large_page[i] = d->large_page[--d->n_large_pages];
+}
+
+/*
+ * Flush @page from @d and @f, along with every large page region
+ * containing it.  Return the number of such regions.
+ * Called with tlb_c.lock held.
+ */
+static unsigned tlb_flush_page_desc_locked(CPUTLBDesc *d, CPUTLBDescFast *f,
+                                           target_ulong page)
+{
+    size_t index = (page >> TARGET_PAGE_BITS) & (tlb_n_entries(f) - 1);
+    unsigned i, n = 0;
+    int k;
+
+    for (i = 0; i < d->n_large_pages; ) {
+        if ((page & d->large_page[i].mask) == d->large_page[i].addr) {
+            tlb_flush_large_page_locked(d, f, i);
+            n++;
+        } else {
+            i++;
+        }
+    }
+    if (tlb_flush_entry_locked(&f->table[index], page)) {
+        d->n_used_entries--;
+    }
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        if (tlb_flush_entry_locked(&d->vtable[k], page)) {
+            d->n_used_entries--;
+        }
+    }
+    return n;
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_saved_flush_page_locked(CPUArchState *env, int midx,
+                                        target_ulong page)
+{
+    CPUTLBSaved *saved = env_tlb(env)->c.saved;
+    int i;
+
+    for (i = 0; saved && i < CPU_TLB_SAVED_CONTEXTS; i++) {
+        CPUTLBContext *ctx = &saved->ctx[i];
+
+        if (ctx->valid && (ctx->dirty & (1 << midx))) {
+            tlb_flush_page_desc_locked(&ctx->d[midx], &ctx->f[midx], page);
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLB *tlb = env_tlb(env);
+    unsigned n;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
-            tlb_n_used_entries_dec(env, midx);
-        }
-        tlb_flush_vtlb_page_locked(env, midx, page);
+    assert_cpu_is_self(env_cpu(env));
+
+    n = tlb_flush_page_desc_locked(&tlb->d[midx], &tlb->f[midx], page);
+    if (n) {
+        qatomic_set(&tlb->c.large_flush_count, tlb->c.large_flush_count + n);
     }
+    tlb_saved_flush_page_locked(env, midx, page);
 }
 
 /**
@@ -547,50 +850,6 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
     tb_jmp_cache_clear_page(cpu, addr);
 }
 
-/**
- * tlb_flush_page_by_mmuidx_async_1:
- * @cpu: cpu on which to flush
- * @data: encoded addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The idxmap parameter is encoded in the page
- * offset of the target_ptr field.  This limits the set of mmu_idx
- * that can be passed via this method.
- */
-static void tlb_flush_page_by_mmuidx_async_1(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    target_ulong addr_and_idxmap = (target_ulong) data.target_ptr;
-    target_ulong addr = addr_and_idxmap & TARGET_PAGE_MASK;
-    uint16_t idxmap = addr_and_idxmap & ~TARGET_PAGE_MASK;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-}
-
-typedef struct {
-    target_ulong addr;
-    uint16_t idxmap;
-} TLBFlushPageByMMUIdxData;
-
-/**
- * tlb_flush_page_by_mmuidx_async_2:
- * @cpu: cpu on which to flush
- * @data: allocated addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The addr+idxmap parameters are stored in a
- * TLBFlushPageByMMUIdxData structure that has been allocated
- * specifically for this helper.  Free the structure when done.
- */
-static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    TLBFlushPageByMMUIdxData *d = data.host_ptr;
-
-    tlb_flush_page_by_mmuidx_async_0(cpu, d->addr, d->idxmap);
-    g_free(d);
-}
-
 void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 {
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n", addr, idxmap);
@@ -600,22 +859,9 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_flush_queue_push(cpu, addr, TARGET_PAGE_SIZE, idxmap,
+                             TARGET_LONG_BITS, false);
     }
 }
 
@@ -627,32 +873,17 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
                                        uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_queue_push(dst_cpu, addr, TARGET_PAGE_SIZE, idxmap,
+                                 TARGET_LONG_BITS, false);
         }
     }
 
@@ -668,41 +899,22 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               target_ulong addr,
                                               uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                              RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_queue_push(dst_cpu, addr, TARGET_PAGE_SIZE, idxmap,
+                                 TARGET_LONG_BITS, false);
         }
-
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(d));
     }
+
+    tlb_flush_queue_push(src_cpu, addr, TARGET_PAGE_SIZE, idxmap,
+                         TARGET_LONG_BITS, true);
 }
 
 void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
@@ -737,16 +949,20 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 
     /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
+     * Flush the large page regions that overlap the range.  If not all
+     * bits are significant, other addresses may alias the range as well.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
+    for (unsigned i = 0; i < d->n_large_pages; ) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        if (bits < TARGET_LONG_BITS ||
+            (lp->addr <= addr + len - 1 && addr <= (lp->addr | ~lp->mask))) {
+            tlb_flush_large_page_locked(d, f, i);
+            qatomic_set(&env_tlb(env)->c.large_flush_count,
+                        env_tlb(env)->c.large_flush_count + 1);
+        } else {
+            i++;
+        }
     }
 
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
@@ -760,13 +976,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 }
 
-typedef struct {
-    target_ulong addr;
-    target_ulong len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -784,6 +993,8 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
             tlb_flush_range_locked(env, mmu_idx, d.addr, d.len, d.bits);
         }
     }
+    /* Ranges are rare enough not to be worth tracking in saved TLBs. */
+    tlb_saved_flush_locked(env, d.idxmap);
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
     /*
@@ -806,12 +1017,133 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
 }
 
-static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
-                                              run_on_cpu_data data)
+static void tlb_flush_queue_drain(CPUState *cpu, bool safe)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBFlushQueue *q = env_tlb(env)->c.flush_queue;
+    TLBFlushRangeData range[CPU_TLB_FLUSH_QUEUE_LEN];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&q->lock);
+    full = q->full_idxmap;
+    n = q->n;
+    memcpy(range, q->range, n * sizeof(range[0]));
+    q->full_idxmap = 0;
+    q->n = 0;
+    if (safe) {
+        q->safe_scheduled = false;
+    } else {
+        q->scheduled = false;
+    }
+    qemu_spin_unlock(&q->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_self(cpu, full, true);
+    }
+    for (i = 0; i < n; i++) {
+        TLBFlushRangeData d = range[i];
+
+        d.idxmap &= ~full;
+        if (d.idxmap == 0) {
+            continue;
+        }
+        if (d.len == TARGET_PAGE_SIZE && d.bits >= TARGET_LONG_BITS) {
+            tlb_flush_page_by_mmuidx_async_0(cpu, d.addr, d.idxmap);
+        } else {
+            tlb_flush_range_by_mmuidx_async_0(cpu, d);
+        }
+    }
+}
+
+static void tlb_flush_queue_work(CPUState *cpu, run_on_cpu_data data)
 {
-    TLBFlushRangeData *d = data.host_ptr;
-    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    tlb_flush_queue_drain(cpu, false);
+}
+
+static void tlb_flush_queue_work_safe(CPUState *cpu, run_on_cpu_data data)
+{
+    tlb_flush_queue_drain(cpu, true);
+}
+
+/*
+ * Queue a flush for @cpu.  With @synced, @cpu is the source of a synced
+ * flush: the queue is then drained by safe work, which only runs once all
+ * cpus have left their TBs, and one pending safe work item serves all the
+ * synced flushes queued before it runs.
+ */
+static void tlb_flush_queue_push(CPUState *cpu, target_ulong addr,
+                                 target_ulong len, uint16_t idxmap,
+                                 unsigned bits, bool synced)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    CPUTLBFlushQueue *q = c->flush_queue;
+    target_ulong last = addr + len - 1;
+    bool schedule;
+    unsigned i;
+
+    qemu_spin_lock(&q->lock);
+    if (synced) {
+        schedule = !q->safe_scheduled;
+        q->safe_scheduled = true;
+    } else {
+        schedule = !q->scheduled;
+        q->scheduled = true;
+    }
+
+    idxmap &= ~q->full_idxmap;
+    if (idxmap == 0) {
+        goto done;
+    }
+
+    /*
+     * Merging two ranges flushes at least both of them, so it is
+     * always safe; only merge those that touch to avoid flushing
+     * unrelated pages.
+     */
+    for (i = 0; i < q->n; i++) {
+        TLBFlushRangeData *r = &q->range[i];
+        target_ulong r_last = r->addr + r->len - 1;
+
+        if (r->idxmap == idxmap && r->bits == bits &&
+            addr <= r_last + 1 && r->addr <= last + 1) {
+            r->addr = MIN(r->addr, addr);
+            r->len = MAX(r_last, last) - r->addr + 1;
+            goto done;
+        }
+    }
+
+    if (q->n < CPU_TLB_FLUSH_QUEUE_LEN) {
+        q->range[q->n].addr = addr;
+        q->range[q->n].len = len;
+        q->range[q->n].idxmap = idxmap;
+        q->range[q->n].bits = bits;
+        q->n++;
+    } else {
+        /* Too many distinct ranges: flush their mmu_idx entirely. */
+        q->full_idxmap |= idxmap;
+        for (i = 0; i < q->n; i++) {
+            q->full_idxmap |= q->range[i].idxmap;
+        }
+        q->n = 0;
+    }
+
+ done:
+    if (!schedule) {
+        /* Only updated under the lock; readers use qatomic_read. */
+        qatomic_set(&c->coalesced_flush_count, c->coalesced_flush_count + 1);
+    }
+    qemu_spin_unlock(&q->lock);
+
+    if (!schedule) {
+        return;
+    }
+    if (synced) {
+        async_safe_run_on_cpu(cpu, tlb_flush_queue_work_safe, RUN_ON_CPU_NULL);
+    } else {
+        async_run_on_cpu(cpu, tlb_flush_queue_work, RUN_ON_CPU_NULL);
+    }
 }
 
 void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
@@ -843,10 +1175,7 @@ void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_range_by_mmuidx_async_0(cpu, d);
     } else {
-        /* Otherwise allocate a structure, freed by the worker.  */
-        TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
-                         RUN_ON_CPU_HOST_PTR(p));
+        tlb_flush_queue_push(cpu, d.addr, len, idxmap, bits, false);
     }
 }
 
@@ -883,13 +1212,9 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
         if (dst_cpu != src_cpu) {
-            TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu,
-                             tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
+            tlb_flush_queue_push(dst_cpu, d.addr, len, idxmap, bits, false);
         }
     }
 
@@ -910,7 +1235,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                uint16_t idxmap,
                                                unsigned bits)
 {
-    TLBFlushRangeData d, *p;
+    TLBFlushRangeData d;
     CPUState *dst_cpu;
 
     /*
@@ -933,18 +1258,13 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
         if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
+            tlb_flush_queue_push(dst_cpu, d.addr, len, idxmap, bits, false);
         }
     }
 
-    p = g_memdup(&d, sizeof(d));
-    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
-                          RUN_ON_CPU_HOST_PTR(p));
+    tlb_flush_queue_push(src_cpu, d.addr, len, idxmap, bits, true);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
@@ -1045,6 +1365,30 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
     }
+    if (env_tlb(env)->c.saved) {
+        CPUTLBSaved *saved = env_tlb(env)->c.saved;
+        int j;
+
+        for (j = 0; j < CPU_TLB_SAVED_CONTEXTS; j++) {
+            CPUTLBContext *ctx = &saved->ctx[j];
+
+            for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+                unsigned int i, n = tlb_n_entries(&ctx->f[mmu_idx]);
+
+                if (!ctx->valid || !(ctx->dirty & (1 << mmu_idx))) {
+                    continue;
+                }
+                for (i = 0; i < n; i++) {
+                    tlb_reset_dirty_range_locked(&ctx->f[mmu_idx].table[i],
+                                                 start1, length);
+                }
+                for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                    tlb_reset_dirty_range_locked(&ctx->d[mmu_idx].vtable[i],
+                                                 start1, length);
+                }
+            }
+        }
+    }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
@@ -1081,28 +1425,46 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush all of an area if any page in it is invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
     target_ulong lp_mask = ~(size - 1);
+    target_ulong best_mask = 0;
+    unsigned i, best = 0;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
-            lp_mask <<= 1;
+    vaddr &= lp_mask;
+    for (i = 0; i < d->n_large_pages; i++) {
+        if ((vaddr & d->large_page[i].mask) == d->large_page[i].addr) {
+            /* Already covered.  */
+            return;
         }
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+    if (d->n_large_pages < CPU_TLB_LARGE_PAGES) {
+        d->large_page[d->n_large_pages].addr = vaddr;
+        d->large_page[d->n_large_pages].mask = lp_mask;
+        d->n_large_pages++;
+        return;
+    }
+
+    /* Extend the region that stays smallest to include the new page.
+       This is a compromise between unnecessary flushes and
+       the cost of maintaining a full variable size TLB.  */
+    for (i = 0; i < d->n_large_pages; i++) {
+        target_ulong mask = lp_mask & d->large_page[i].mask;
+
+        while (((d->large_page[i].addr ^ vaddr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (mask > best_mask) {
+            best_mask = mask;
+            best = i;
+        }
+    }
+    d->large_page[best].addr = vaddr & best_mask;
+    d->large_page[best].mask = best_mask;
 }
 
 /*
@@ -1503,6 +1865,12 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
+    /*
+     * TLB_NOTDIRTY covers the whole page, so stores to data that shares
+     * a page with code still come here rather than stay on the fast path.
+     * tb_invalidate_phys_range_fast() returns at once for them, from the
+     * chunk bitmap of the page, without locking it.
+     */
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
         tb_invalidate_phys_range_fast(ram_addr, size, retaddr);
     }
@@ -2,13 +2,39 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/util.h"
 #include "exec/exec-all.h"
 #include "monitor/monitor.h"
 
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 10);
+    const char *sort = qdict_get_try_str(qdict, "sort");
+    g_autoptr(HumanReadableText) info = NULL;
+    Error *err = NULL;
+    int sort_by;
+
+    sort_by = qapi_enum_parse(&TbStatsSortBy_lookup, sort,
+                              TB_STATS_SORT_BY_EXECUTIONS, &err);
+    if (err) {
+        error_report_err(err);
+        return;
+    }
+
+    info = qmp_x_query_tb_stats(true, max, true, sort_by, &err);
+    if (err) {
+        error_report_err(err);
+        return;
+    }
+    monitor_puts(mon, info->human_readable_text);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp("tb-stats", true, hmp_info_tb_stats);
 }
 
 type_init(hmp_tcg_register);
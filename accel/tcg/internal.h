@@ -23,6 +23,14 @@
 #define assert_memory_lock() tcg_debug_assert(have_mmap_lock())
 #endif
 
+/* Executions of a cold TB before it is optimized, or 0 to always optimize */
+extern unsigned int tcg_tier_threshold;
+/* Translate the direct successors of each new TB ahead of execution */
+extern bool tcg_tb_prefetch;
+/* Predict the targets of indirect branches, and of returns, inline */
+extern bool tcg_ibtc;
+extern bool tcg_ras;
+
 #if defined(CONFIG_SOFTMMU) && defined(CONFIG_DEBUG_TCG)
 void assert_no_pages_locked(void);
 #else
@@ -45,6 +53,15 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
                               target_ulong cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             target_ulong pc);
+bool tb_prefetch(CPUState *cpu, const TranslationBlock *tb,
+                 target_ulong tb_vaddr, target_ulong pc);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags,
+                                   uint32_t cflags);
+void tb_reclaim(CPUState *cpu);
+void tcg_exclusive_stats(uint64_t *count, uint64_t *ns);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
@@ -34,7 +34,13 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_evict_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_tier_up_count;
+    unsigned tb_superblock_count;
+    unsigned tb_jumps_followed;
+    unsigned tb_prefetch_count;
+    unsigned tb_prefetch_hit_count;
 };
 
 extern TBContext tb_ctx;
@@ -9,58 +9,186 @@
 #ifndef ACCEL_TCG_TB_JMP_CACHE_H
 #define ACCEL_TCG_TB_JMP_CACHE_H
 
+/* Initial and minimum size of the cache */
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/* Maximum size of the cache, see tb_jmp_cache_resize */
+#define TB_JMP_CACHE_MAX_BITS 16
+/* Number of entries of the fully associative victim cache */
+#define TB_JMP_VICTIM_SIZE 8
+/* Number of entries of the indirect branch target cache */
+#define TB_JMP_IBTC_BITS 8
+#define TB_JMP_IBTC_SIZE (1 << TB_JMP_IBTC_BITS)
+/* Depth of the return address stack, a power of 2 */
+#define TB_JMP_RAS_SIZE 16
+
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+#if TARGET_TB_PCREL
+    target_ulong pc;
+#endif
+} CPUJumpCacheEntry;
+
+/*
+ * Predicted target of an indirect branch, probed by the translated code
+ * itself, see translator_lookup_and_goto_ptr().  Entries are filled by
+ * the owning vCPU; other threads may clear 'tb'.
+ */
+typedef struct CPUBranchCacheEntry {
+    target_ulong pc;
+    TranslationBlock *tb;
+} CPUBranchCacheEntry;
 
 /*
  * Accessed in parallel; all accesses to 'tb' must be atomic.
  * For TARGET_TB_PCREL, accesses to 'pc' must be protected by
  * a load_acquire/store_release to 'tb'.
+ *
+ * Only the owning vCPU fills in entries; other threads may clear them.
+ * The owning vCPU replaces the whole structure when resizing it, so
+ * other threads must read cpu->tb_jmp_cache within an RCU critical
+ * section.
  */
 struct CPUJumpCache {
     struct rcu_head rcu;
-    struct {
-        TranslationBlock *tb;
-#if TARGET_TB_PCREL
-        target_ulong pc;
-#endif
-    } array[TB_JMP_CACHE_SIZE];
+    unsigned int bits;
+    unsigned int mask;          /* (1 << bits) - 1 */
+    unsigned int victim_next;   /* next victim entry to replace */
+
+    /* statistics, carried over when resizing */
+    uint64_t hits;
+    uint64_t victim_hits;
+    uint64_t misses;
+    /* value of hits + victim_hits + misses, and misses, at last resize */
+    uint64_t window_lookups;
+    uint64_t window_misses;
+    /* number of helper calls from the inline branch caches */
+    uint64_t ibtc_misses;
+    uint64_t ras_misses;
+
+    /* Indirect branch target cache, indexed by a hash of the branch pc */
+    CPUBranchCacheEntry ibtc[TB_JMP_IBTC_SIZE];
+    /* Return address stack; ras[ras_top] is the next return */
+    uint32_t ras_top;
+    CPUBranchCacheEntry ras[TB_JMP_RAS_SIZE];
+
+    /* Entries recently displaced from array[] */
+    CPUJumpCacheEntry victim[TB_JMP_VICTIM_SIZE];
+    CPUJumpCacheEntry array[];
 };
 
 static inline TranslationBlock *
-tb_jmp_cache_get_tb(CPUJumpCache *jc, uint32_t hash)
+tb_jmp_entry_get_tb(CPUJumpCacheEntry *e)
 {
 #if TARGET_TB_PCREL
-    /* Use acquire to ensure current load of pc from jc. */
-    return qatomic_load_acquire(&jc->array[hash].tb);
+    /* Use acquire to ensure current load of pc from e. */
+    return qatomic_load_acquire(&e->tb);
 #else
     /* Use rcu_read to ensure current load of pc from *tb. */
-    return qatomic_rcu_read(&jc->array[hash].tb);
+    return qatomic_rcu_read(&e->tb);
 #endif
 }
 
 static inline target_ulong
-tb_jmp_cache_get_pc(CPUJumpCache *jc, uint32_t hash, TranslationBlock *tb)
+tb_jmp_entry_get_pc(CPUJumpCacheEntry *e, TranslationBlock *tb)
 {
 #if TARGET_TB_PCREL
-    return jc->array[hash].pc;
+    return e->pc;
 #else
     return tb_pc(tb);
 #endif
 }
 
 static inline void
-tb_jmp_cache_set(CPUJumpCache *jc, uint32_t hash,
-                 TranslationBlock *tb, target_ulong pc)
+tb_jmp_entry_set(CPUJumpCacheEntry *e, TranslationBlock *tb, target_ulong pc)
 {
 #if TARGET_TB_PCREL
-    jc->array[hash].pc = pc;
+    e->pc = pc;
     /* Use store_release on tb to ensure pc is written first. */
-    qatomic_store_release(&jc->array[hash].tb, tb);
+    qatomic_store_release(&e->tb, tb);
 #else
     /* Use the pc value already stored in tb->pc. */
-    qatomic_set(&jc->array[hash].tb, tb);
+    qatomic_set(&e->tb, tb);
 #endif
 }
 
+static inline TranslationBlock *
+tb_jmp_cache_get_tb(CPUJumpCache *jc, uint32_t hash)
+{
+    return tb_jmp_entry_get_tb(&jc->array[hash]);
+}
+
+static inline target_ulong
+tb_jmp_cache_get_pc(CPUJumpCache *jc, uint32_t hash, TranslationBlock *tb)
+{
+    return tb_jmp_entry_get_pc(&jc->array[hash], tb);
+}
+
+static inline void
+tb_jmp_cache_set(CPUJumpCache *jc, uint32_t hash,
+                 TranslationBlock *tb, target_ulong pc)
+{
+    CPUJumpCacheEntry *e = &jc->array[hash];
+    TranslationBlock *old = tb_jmp_entry_get_tb(e);
+
+    /* Keep the entry being replaced in the victim cache. */
+    if (old && old != tb) {
+        unsigned int i = jc->victim_next++ % TB_JMP_VICTIM_SIZE;
+
+        tb_jmp_entry_set(&jc->victim[i], old, tb_jmp_entry_get_pc(e, old));
+    }
+    tb_jmp_entry_set(e, tb, pc);
+}
+
+/*
+ * Forget all predicted branch targets.  They are keyed by virtual
+ * address, so this must be done whenever the mapping of any page may
+ * have changed.
+ */
+static inline void tb_jmp_cache_clear_branches(CPUJumpCache *jc)
+{
+    unsigned int i;
+
+    for (i = 0; i < TB_JMP_IBTC_SIZE; i++) {
+        qatomic_set(&jc->ibtc[i].tb, NULL);
+    }
+    for (i = 0; i < TB_JMP_RAS_SIZE; i++) {
+        qatomic_set(&jc->ras[i].tb, NULL);
+    }
+}
+
+/* Call @drop for each TB in @jc, and drop its entry if it returns true. */
+static inline void
+tb_jmp_cache_filter(CPUJumpCache *jc, bool (*drop)(TranslationBlock *tb))
+{
+    unsigned int i;
+
+    for (i = 0; i <= jc->mask; i++) {
+        TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+        if (tb && drop(tb)) {
+            qatomic_set(&jc->array[i].tb, NULL);
+        }
+    }
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        TranslationBlock *tb = qatomic_read(&jc->victim[i].tb);
+        if (tb && drop(tb)) {
+            qatomic_set(&jc->victim[i].tb, NULL);
+        }
+    }
+    for (i = 0; i < TB_JMP_IBTC_SIZE; i++) {
+        TranslationBlock *tb = qatomic_read(&jc->ibtc[i].tb);
+        if (tb && drop(tb)) {
+            qatomic_set(&jc->ibtc[i].tb, NULL);
+        }
+    }
+    for (i = 0; i < TB_JMP_RAS_SIZE; i++) {
+        TranslationBlock *tb = qatomic_read(&jc->ras[i].tb);
+        if (tb && drop(tb)) {
+            qatomic_set(&jc->ras[i].tb, NULL);
+        }
+    }
+}
+
+CPUJumpCache *tb_jmp_cache_new(unsigned int bits);
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -19,6 +19,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/interval-tree.h"
+#include "qemu/bitmap.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
@@ -186,10 +187,21 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+/*
+ * Each page is divided into 64 chunks, a cache line for 4KiB pages.
+ * The code map of a page has a bit set for each chunk that may hold
+ * code of one of its TBs.
+ */
+#define PAGE_CODE_CHUNKS     64
+#define PAGE_CODE_CHUNK_BITS (TARGET_PAGE_BITS - 6)
+#define PAGE_CODE_MAP_WORDS  BITS_TO_LONGS(PAGE_CODE_CHUNKS)
+
 struct PageDesc {
     QemuSpin lock;
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
+    /* written with the lock held, may be read without it */
+    unsigned long code_map[PAGE_CODE_MAP_WORDS];
 };
 
 void page_table_config_init(void)
@@ -565,6 +577,88 @@ static void page_collection_unlock(struct page_collection *set)
     g_free(set);
 }
 
+/*
+ * Return the range [*@start, *@end[ of offsets within its @n'th page that
+ * is covered by @tb.
+ */
+static void tb_page_range(const TranslationBlock *tb, unsigned int n,
+                          unsigned int *start, unsigned int *end)
+{
+    /* Count a TB of size 0 as covering its first byte. */
+    target_ulong size = MAX(tb->size, 1);
+
+    if (n == 0) {
+        *start = tb_page_addr0(tb) & ~TARGET_PAGE_MASK;
+        *end = MIN(*start + size, TARGET_PAGE_SIZE);
+    } else {
+        *start = 0;
+        *end = (tb_page_addr0(tb) + size) & ~TARGET_PAGE_MASK;
+    }
+}
+
+/* Set the bits of the chunks [@start, @end[ of the page in @map. */
+static void page_code_map_set(unsigned long *map,
+                              unsigned int start, unsigned int end)
+{
+    unsigned int first = start >> PAGE_CODE_CHUNK_BITS;
+    unsigned int last = (end - 1) >> PAGE_CODE_CHUNK_BITS;
+
+    bitmap_set(map, first, last - first + 1);
+}
+
+/* Store @map as the code map of @pd, whose lock must be held. */
+static void page_code_map_store(PageDesc *pd, const unsigned long *map)
+{
+    for (int i = 0; i < PAGE_CODE_MAP_WORDS; i++) {
+        qatomic_set(&pd->code_map[i], map[i]);
+    }
+}
+
+static void page_code_map_clear(PageDesc *pd)
+{
+    DECLARE_BITMAP(map, PAGE_CODE_CHUNKS) = { };
+
+    page_code_map_store(pd, map);
+}
+
+/*
+ * Return true if the page offsets [@start, @end[ may hold code of a TB
+ * of @pd.  May be called without the lock of @pd: a TB linked
+ * concurrently with the check may or may not be seen, as is the case
+ * if the lock is taken after the check.
+ */
+static bool page_code_map_test(PageDesc *pd,
+                               unsigned int start, unsigned int end)
+{
+    unsigned int i = start >> PAGE_CODE_CHUNK_BITS;
+    unsigned int last = (end - 1) >> PAGE_CODE_CHUNK_BITS;
+
+    for (; i <= last; i++) {
+        if (qatomic_read(&pd->code_map[BIT_WORD(i)]) & BIT_MASK(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Recompute the code map of @pd from its remaining TBs, after some of
+ * them have been invalidated.  Call with the lock of @pd held.
+ */
+static void page_code_map_rebuild(PageDesc *pd)
+{
+    DECLARE_BITMAP(map, PAGE_CODE_CHUNKS) = { };
+    TranslationBlock *tb;
+    unsigned int start, end;
+    PageForEachNext n;
+
+    PAGE_FOR_EACH_TB(unused, unused, pd, tb, n) {
+        tb_page_range(tb, n, &start, &end);
+        page_code_map_set(map, start, end);
+    }
+    page_code_map_store(pd, map);
+}
+
 /* Set to NULL all the 'first_tb' fields in all PageDescs. */
 static void tb_remove_all_1(int level, void **lp)
 {
@@ -579,6 +673,7 @@ static void tb_remove_all_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
+            page_code_map_clear(&pd[i]);
             page_unlock(&pd[i]);
         }
     } else {
@@ -606,10 +701,18 @@ static void tb_remove_all(void)
 static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
                                unsigned int n)
 {
+    DECLARE_BITMAP(map, PAGE_CODE_CHUNKS);
+    unsigned int start, end;
     bool page_already_protected;
 
     assert_page_locked(p);
 
+    /* Writes to the code of @tb must see it from now on. */
+    bitmap_copy(map, p->code_map, PAGE_CODE_CHUNKS);
+    tb_page_range(tb, n, &start, &end);
+    page_code_map_set(map, start, end);
+    page_code_map_store(p, map);
+
     tb->page_next[n] = p->first_tb;
     page_already_protected = p->first_tb != 0;
     p->first_tb = (uintptr_t)tb | n;
@@ -853,14 +956,21 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb_pc(tb));
+        RCU_READ_LOCK_GUARD();
 
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+            uint32_t h = tb_jmp_cache_hash_func(jc, tb_pc(tb));
+            int i;
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
             }
+            for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+                if (qatomic_read(&jc->victim[i].tb) == tb) {
+                    qatomic_set(&jc->victim[i].tb, NULL);
+                }
+            }
         }
     }
 }
@@ -910,11 +1020,13 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
                 tb_ctx.tb_phys_invalidate_count + 1);
 }
 
+/*
+ * Call with the TB's pages' locks held, between qemu_thread_jit_write()
+ * and qemu_thread_jit_execute(): callers invalidate TBs in batches.
+ */
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
-    qemu_thread_jit_write();
     do_tb_phys_invalidate(tb, true);
-    qemu_thread_jit_execute();
 }
 
 /*
@@ -932,6 +1044,101 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
 }
 
+/* Remove every reference to @tb, whose memory is about to be reused. */
+static gboolean tb_evict(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    if (tb_page_addr0(tb) == -1) {
+        /*
+         * A one-shot TB for I/O is not in the hash table, so invalidating
+         * it does not unlink its jumps.  Nothing else ever does either.
+         */
+        qemu_spin_lock(&tb->jmp_lock);
+        qatomic_set(&tb->cflags, tb->cflags | CF_INVALID);
+        qemu_spin_unlock(&tb->jmp_lock);
+        tb_remove_from_jmp_list(tb, 0);
+        tb_remove_from_jmp_list(tb, 1);
+        tb_jmp_unlink(tb);
+    } else if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+    return false;
+}
+
+static bool tb_reclaim_touch(TranslationBlock *tb)
+{
+    tcg_region_touch(tb->tc.ptr);
+    return false;
+}
+
+static bool tb_reclaim_is_invalid(TranslationBlock *tb)
+{
+    return tb_cflags(tb) & CF_INVALID;
+}
+
+static void do_tb_reclaim(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *c;
+    bool evicted;
+
+    mmap_lock();
+    /*
+     * If the buffer has been flushed, or a region freed, on request of
+     * another CPU, there is nothing to do.
+     */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int ||
+        tcg_region_has_free()) {
+        mmap_unlock();
+        return;
+    }
+
+    /* The TBs in the jump caches are the most recently executed. */
+    CPU_FOREACH(c) {
+        tb_jmp_cache_filter(c->tb_jmp_cache, tb_reclaim_touch);
+    }
+
+    qemu_thread_jit_write();
+    evicted = tcg_region_evict(tb_evict);
+    qemu_thread_jit_execute();
+
+    if (evicted) {
+        /*
+         * Invalidation only drops the jump cache entry for the pc of
+         * each TB: drop any other stale entry before the memory of the
+         * evicted TBs is reused.
+         */
+        CPU_FOREACH(c) {
+            tb_jmp_cache_filter(c->tb_jmp_cache, tb_reclaim_is_invalid);
+        }
+        qatomic_inc(&tb_ctx.tb_evict_count);
+    }
+    mmap_unlock();
+
+    if (evicted) {
+        qemu_plugin_flush_cb();
+    } else {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/*
+ * Make room in the code buffer.  Evict the code of the least recently
+ * used region, if there is one that no TCG context is generating code
+ * into.  Otherwise, flush all code.
+ */
+void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_reclaim(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_reclaim,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /*
  * Add a new TB and link it to the physical page tables. phys_page2 is
  * (-1) to indicate that only one page contains the TB.
@@ -996,9 +1203,11 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
 
     assert_memory_lock();
 
+    qemu_thread_jit_write();
     PAGE_FOR_EACH_TB(start, end, unused, tb, n) {
         tb_phys_invalidate__locked(tb);
     }
+    qemu_thread_jit_execute();
 }
 
 /*
@@ -1047,6 +1256,7 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
     addr &= TARGET_PAGE_MASK;
     current_tb_modified = false;
 
+    qemu_thread_jit_write();
     PAGE_FOR_EACH_TB(addr, addr + TARGET_PAGE_SIZE, unused, tb, n) {
         if (current_tb == tb &&
             (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
@@ -1062,6 +1272,7 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
         }
         tb_phys_invalidate__locked(tb);
     }
+    qemu_thread_jit_execute();
 
     if (current_tb_modified) {
         /* Force execution of one insn next time.  */
@@ -1072,9 +1283,34 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
     return false;
 }
 #else
+/*
+ * Lock @p if none of its TBs extends to another page, and return true.
+ * Invalidating those TBs then needs no other lock, and the page need not
+ * be tracked in a page_collection.  Otherwise return false, with @p
+ * unlocked: locks must then be taken in order by page_collection_lock().
+ *
+ * A TB spanning two pages is linked with both pages locked, so it cannot
+ * appear in the list of @p while it is locked.
+ */
+static bool page_lock_if_private(PageDesc *p)
+{
+    TranslationBlock *tb;
+    PageForEachNext n;
+
+    page_lock(p);
+    PAGE_FOR_EACH_TB(unused, unused, p, tb, n) {
+        if (tb_page_addr1(tb) != -1) {
+            page_unlock(p);
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
  * @p must be non-NULL.
- * Call with all @pages locked.
+ * Call with all @pages locked, or with @pages NULL and only @p locked
+ * by page_lock_if_private().
  */
 static void
 tb_invalidate_phys_page_range__locked(struct page_collection *pages,
@@ -1094,6 +1330,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
      * We remove all the TBs in the range [start, end[.
      * XXX: see if in some cases it could be faster to invalidate all the code
      */
+    qemu_thread_jit_write();
     PAGE_FOR_EACH_TB(start, end, p, tb, n) {
         /* NOTE: this is subtle as a TB may span two physical pages */
         if (n == 0) {
@@ -1124,15 +1361,23 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             tb_phys_invalidate__locked(tb);
         }
     }
+    qemu_thread_jit_execute();
 
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
+        page_code_map_clear(p);
         tlb_unprotect_code(start);
+    } else {
+        page_code_map_rebuild(p);
     }
 
 #ifdef TARGET_HAS_PRECISE_SMC
     if (current_tb_modified) {
-        page_collection_unlock(pages);
+        if (pages) {
+            page_collection_unlock(pages);
+        } else {
+            page_unlock(p);
+        }
         /* Force execution of one insn next time.  */
         current_cpu->cflags_next_tb = 1 | CF_NOIRQ | curr_cflags(current_cpu);
         mmap_unlock();
@@ -1158,6 +1403,11 @@ void tb_invalidate_phys_page(tb_page_addr_t addr)
 
     start = addr & TARGET_PAGE_MASK;
     end = start + TARGET_PAGE_SIZE;
+    if (page_lock_if_private(p)) {
+        tb_invalidate_phys_page_range__locked(NULL, p, start, end, 0);
+        page_unlock(p);
+        return;
+    }
     pages = page_collection_lock(start, end);
     tb_invalidate_phys_page_range__locked(pages, p, start, end, 0);
     page_collection_unlock(pages);
@@ -1175,7 +1425,11 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
     struct page_collection *pages;
     tb_page_addr_t next;
 
-    pages = page_collection_lock(start, end);
+    /*
+     * The pages are independent: invalidate them one at a time, so that
+     * pages whose TBs do not extend to another page are only locked for
+     * themselves.
+     */
     for (next = (start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
          start < end;
          start = next, next += TARGET_PAGE_SIZE) {
@@ -1185,10 +1439,16 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
         if (pd == NULL) {
             continue;
         }
+        if (page_lock_if_private(pd)) {
+            tb_invalidate_phys_page_range__locked(NULL, pd, start, bound, 0);
+            page_unlock(pd);
+            continue;
+        }
+        pages = page_collection_lock(start, bound);
         assert_page_locked(pd);
         tb_invalidate_phys_page_range__locked(pages, pd, start, bound, 0);
+        page_collection_unlock(pages);
     }
-    page_collection_unlock(pages);
 }
 
 /*
@@ -1219,6 +1479,27 @@ void tb_invalidate_phys_range_fast(ram_addr_t ram_addr,
                                    uintptr_t retaddr)
 {
     struct page_collection *pages;
+    PageDesc *p;
+
+    p = page_find(ram_addr >> TARGET_PAGE_BITS);
+    if (p == NULL) {
+        return;
+    }
+    /*
+     * The write may be to data sharing the page with code.  If the page
+     * has no code at all, take the lock so that it gets unprotected.
+     */
+    if (qatomic_read(&p->first_tb) &&
+        !page_code_map_test(p, ram_addr & ~TARGET_PAGE_MASK,
+                            (ram_addr & ~TARGET_PAGE_MASK) + size)) {
+        return;
+    }
+    if (page_lock_if_private(p)) {
+        tb_invalidate_phys_page_range__locked(NULL, p, ram_addr,
+                                              ram_addr + size, retaddr);
+        page_unlock(p);
+        return;
+    }
 
     pages = page_collection_lock(ram_addr, ram_addr + size);
     tb_invalidate_phys_page_fast__locked(pages, ram_addr, size, retaddr);
@@ -0,0 +1,278 @@
+/*
+ * Persistent translation profile.
+ *
+ * Generated host code cannot be reused from one run to the next: it
+ * embeds the absolute addresses of helpers, of the TranslationBlock
+ * itself and of the epilogue, all of which move with ASLR and with the
+ * layout of the code buffer.  What does carry over is the knowledge of
+ * which blocks the guest will execute.
+ *
+ * Each translated block is recorded by the hash of the contents of its
+ * guest page, its offset within the page, and its cs_base, flags and
+ * cflags.  Keying on contents rather than addresses lets the profile
+ * survive guest address space randomization.  On a later run, the first
+ * translation from a page whose contents match a recorded page
+ * translates all of the other recorded blocks of that page at once,
+ * while the page is known to be mapped and the cpu state is known to
+ * match.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+#include "tb-profile.h"
+
+#define TB_PROFILE_MAGIC    0x50425451  /* "QTBP" */
+#define TB_PROFILE_VERSION  1
+
+typedef struct TBProfileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t page_bits;
+    uint32_t nb_entries;
+    char target[16];
+} TBProfileHeader;
+
+typedef struct TBProfileEntry {
+    uint64_t page_hash;
+    uint64_t cs_base;
+    uint32_t page_offset;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t pad;
+} TBProfileEntry;
+
+static struct {
+    QemuMutex lock;
+    char *path;
+    /* Set of TBProfileEntry translated during this run. */
+    GHashTable *seen;
+    /* Page hash -> GArray of TBProfileEntry, from the previous run. */
+    GHashTable *pages;
+    /* statistics */
+    size_t nb_loaded;
+    size_t nb_pages_hit;
+    size_t nb_prefetched;
+} tb_profile;
+
+static uint64_t tb_profile_page_hash(const void *page)
+{
+    const uint64_t *p = page;
+    uint64_t h = TARGET_PAGE_SIZE;
+    size_t i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE / sizeof(uint64_t); i++) {
+        h = (h ^ ldq_he_p(p + i)) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static guint tb_profile_entry_hash(gconstpointer p)
+{
+    const TBProfileEntry *e = p;
+
+    return qemu_xxhash7(e->page_hash, e->cs_base, e->page_offset,
+                        e->flags, e->cflags);
+}
+
+static gboolean tb_profile_entry_equal(gconstpointer a, gconstpointer b)
+{
+    return memcmp(a, b, sizeof(TBProfileEntry)) == 0;
+}
+
+/* Call with tb_profile.lock held. */
+static void tb_profile_add_seen(const TBProfileEntry *e)
+{
+    if (!g_hash_table_contains(tb_profile.seen, e)) {
+        g_hash_table_add(tb_profile.seen, g_memdup2(e, sizeof(*e)));
+    }
+}
+
+static void tb_profile_load(const char *path)
+{
+    g_autofree TBProfileEntry *entries = NULL;
+    TBProfileHeader hdr;
+    uint32_t i;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            warn_report("Could not open translation profile %s: %s",
+                        path, strerror(errno));
+        }
+        return;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        hdr.magic != TB_PROFILE_MAGIC ||
+        hdr.version != TB_PROFILE_VERSION ||
+        hdr.page_bits != TARGET_PAGE_BITS ||
+        strncmp(hdr.target, TARGET_NAME, sizeof(hdr.target)) != 0) {
+        warn_report("%s is not a translation profile for %s, ignoring it",
+                    path, TARGET_NAME);
+        goto out;
+    }
+
+    entries = g_try_new(TBProfileEntry, hdr.nb_entries);
+    if (entries == NULL ||
+        fread(entries, sizeof(*entries), hdr.nb_entries, f) != hdr.nb_entries) {
+        warn_report("Translation profile %s is truncated, ignoring it", path);
+        goto out;
+    }
+
+    for (i = 0; i < hdr.nb_entries; i++) {
+        TBProfileEntry *e = &entries[i];
+        GArray *page;
+
+        if (e->page_offset >= TARGET_PAGE_SIZE) {
+            continue;
+        }
+        page = g_hash_table_lookup(tb_profile.pages, &e->page_hash);
+        if (page == NULL) {
+            page = g_array_new(false, false, sizeof(TBProfileEntry));
+            g_hash_table_insert(tb_profile.pages,
+                                g_memdup2(&e->page_hash, sizeof(uint64_t)),
+                                page);
+        }
+        g_array_append_val(page, *e);
+        tb_profile.nb_loaded++;
+    }
+
+ out:
+    fclose(f);
+}
+
+static void tb_profile_save(void)
+{
+    g_autofree char *tmp = g_strdup_printf("%s.tmp", tb_profile.path);
+    TBProfileHeader hdr = { };
+    GHashTableIter iter;
+    gpointer key;
+    bool ok;
+    FILE *f;
+
+    qemu_mutex_lock(&tb_profile.lock);
+
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        warn_report("Could not open %s: %s", tmp, strerror(errno));
+        goto out;
+    }
+
+    hdr.magic = TB_PROFILE_MAGIC;
+    hdr.version = TB_PROFILE_VERSION;
+    hdr.page_bits = TARGET_PAGE_BITS;
+    hdr.nb_entries = g_hash_table_size(tb_profile.seen);
+    pstrcpy(hdr.target, sizeof(hdr.target), TARGET_NAME);
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+    g_hash_table_iter_init(&iter, tb_profile.seen);
+    while (ok && g_hash_table_iter_next(&iter, &key, NULL)) {
+        ok = fwrite(key, sizeof(TBProfileEntry), 1, f) == 1;
+    }
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+
+    if (!ok || rename(tmp, tb_profile.path) != 0) {
+        warn_report("Could not write translation profile %s: %s",
+                    tb_profile.path, strerror(errno));
+        unlink(tmp);
+    }
+
+ out:
+    qemu_mutex_unlock(&tb_profile.lock);
+}
+
+void tb_profile_init(const char *path)
+{
+    qemu_mutex_init(&tb_profile.lock);
+    tb_profile.seen = g_hash_table_new_full(tb_profile_entry_hash,
+                                            tb_profile_entry_equal,
+                                            g_free, NULL);
+    tb_profile.pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free,
+                                             (GDestroyNotify)g_array_unref);
+    tb_profile_load(path);
+    tb_profile.path = g_strdup(path);
+    atexit(tb_profile_save);
+}
+
+void tb_profile_translated(CPUState *cpu, TranslationBlock *tb,
+                           target_ulong pc, void *host_pc)
+{
+    target_ulong offset = pc & ~TARGET_PAGE_MASK;
+    TBProfileEntry e = { };
+    GArray *page;
+    size_t n = 0;
+    guint i;
+
+    /* Only blocks contained in a single page of RAM can be replayed. */
+    if (tb_profile.path == NULL || host_pc == NULL ||
+        tb_page_addr1(tb) != -1) {
+        return;
+    }
+
+    e.page_hash = tb_profile_page_hash(host_pc - offset);
+    e.cs_base = tb->cs_base;
+    e.page_offset = offset;
+    e.flags = tb->flags;
+    e.cflags = tb_cflags(tb);
+
+    qemu_mutex_lock(&tb_profile.lock);
+    tb_profile_add_seen(&e);
+    page = g_hash_table_lookup(tb_profile.pages, &e.page_hash);
+    if (page == NULL) {
+        qemu_mutex_unlock(&tb_profile.lock);
+        return;
+    }
+    /*
+     * Each recorded page is replayed once.  Carry its entries over to
+     * this run's profile whether or not they are replayed now: they
+     * were executed the last time this page was seen.
+     */
+    g_array_ref(page);
+    g_hash_table_remove(tb_profile.pages, &e.page_hash);
+    for (i = 0; i < page->len; i++) {
+        tb_profile_add_seen(&g_array_index(page, TBProfileEntry, i));
+    }
+    tb_profile.nb_pages_hit++;
+    qemu_mutex_unlock(&tb_profile.lock);
+
+    for (i = 0; i < page->len; i++) {
+        TBProfileEntry *p = &g_array_index(page, TBProfileEntry, i);
+        target_ulong vaddr = (pc & TARGET_PAGE_MASK) | p->page_offset;
+
+        /* The cpu state must match for the translation to be valid. */
+        if (p->cs_base == e.cs_base &&
+            p->flags == e.flags &&
+            p->cflags == e.cflags &&
+            tb_prefetch(cpu, tb, pc, vaddr)) {
+            n++;
+        }
+    }
+    g_array_unref(page);
+
+    qatomic_add(&tb_profile.nb_prefetched, n);
+}
+
+void tb_profile_dump_info(GString *buf)
+{
+    if (tb_profile.path == NULL) {
+        return;
+    }
+    g_string_append_printf(buf, "TB profile          %zu blocks loaded, "
+                           "%zu pages matched, %zu blocks prefetched\n",
+                           tb_profile.nb_loaded,
+                           qatomic_read(&tb_profile.nb_pages_hit),
+                           qatomic_read(&tb_profile.nb_prefetched));
+}
@@ -0,0 +1,27 @@
+/*
+ * Persistent translation profile.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_PROFILE_H
+#define ACCEL_TCG_TB_PROFILE_H
+
+/*
+ * Load the translation profile at @path, if it exists, and arrange for
+ * the profile of this run to be written back to @path at exit.
+ */
+void tb_profile_init(const char *path);
+
+/*
+ * Note that @tb was generated for @pc, whose code is found at @host_pc.
+ * If the profile knows other blocks on the same guest page, translate
+ * them now.
+ */
+void tb_profile_translated(CPUState *cpu, TranslationBlock *tb,
+                           target_ulong pc, void *host_pc);
+
+/* Append profile statistics to @buf. */
+void tb_profile_dump_info(GString *buf);
+
+#endif /* ACCEL_TCG_TB_PROFILE_H */
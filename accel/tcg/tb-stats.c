@@ -0,0 +1,216 @@
+/*
+ * Per translation block execution statistics.
+ *
+ * With -accel tcg,tb-stats=on every block is associated with an entry
+ * of a side table, keyed like the TB hash table by physical address,
+ * virtual address, flags and cflags, so that the counts of a block
+ * survive its retranslation while, say, the serial and parallel
+ * translations of the same code are told apart.  The generated code
+ * increments the execution count of its entry on entry to the block;
+ * everything else is recorded when the block is translated.  The
+ * hottest entries are reported by 'info tb-stats'.
+ *
+ * Executions are counted with plain loads and stores, so concurrent
+ * vCPUs may lose increments of the same block: the counts are meant to
+ * rank blocks, not to be exact.  The number of guest instructions
+ * executed is estimated from the length of the latest translation.
+ *
+ * The host side of a block is described by the size of its code, as
+ * TCG does not track host instructions, and by its address, which
+ * -perfmap and -jitdump already associate with the block for perf.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/qht.h"
+#include "exec/exec-all.h"
+#include "tb-hash.h"
+#include "tb-stats.h"
+
+#define TB_STATS_HTABLE_SIZE (1 << 15)
+
+bool tcg_tb_stats;
+
+static struct qht tb_stats_ht;
+
+static bool tb_stats_cmp(const void *ap, const void *bp)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+        a->pc == b->pc &&
+        a->cs_base == b->cs_base &&
+        a->flags == b->flags &&
+        a->cflags == b->cflags;
+}
+
+void tb_stats_init(void)
+{
+    qht_init(&tb_stats_ht, tb_stats_cmp, TB_STATS_HTABLE_SIZE,
+             QHT_MODE_AUTO_RESIZE);
+    tcg_tb_stats = true;
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags,
+                           uint32_t cflags)
+{
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+        .cflags = cflags,
+    };
+    uint32_t hash = tb_hash_func(phys_pc, pc, flags, cflags, 0);
+    TBStatistics *s;
+    void *existing = NULL;
+
+    s = qht_lookup(&tb_stats_ht, &key, hash);
+    if (s) {
+        return s;
+    }
+
+    s = g_new(TBStatistics, 1);
+    *s = key;
+    qemu_spin_init(&s->lock);
+    if (!qht_insert(&tb_stats_ht, s, hash, &existing)) {
+        /* Another vCPU added it first. */
+        g_free(s);
+        s = existing;
+    }
+    return s;
+}
+
+void tb_stats_translated(const TranslationBlock *tb, int64_t ns,
+                         unsigned spills)
+{
+    TBStatistics *s = tb->tb_stats;
+
+    qemu_spin_lock(&s->lock);
+    s->translations++;
+    s->translate_ns += ns;
+    s->guest_insns = tb->icount;
+    s->host_size = tb->tc.size;
+    s->spills = spills;
+    s->host_pc = tb->tc.ptr;
+    qemu_spin_unlock(&s->lock);
+}
+
+static uint64_t tb_stats_key(const TBStatistics *s, TbStatsSortBy sort_by)
+{
+    uint64_t execs = qatomic_read__nocheck(&s->executions);
+
+    switch (sort_by) {
+    case TB_STATS_SORT_BY_EXECUTIONS:
+        return execs;
+    case TB_STATS_SORT_BY_GUEST_INSNS:
+        return execs * s->guest_insns;
+    case TB_STATS_SORT_BY_SPILLS:
+        return s->spills;
+    case TB_STATS_SORT_BY_TRANSLATIONS:
+        return s->translations;
+    case TB_STATS_SORT_BY_TRANSLATE_TIME:
+        return s->translate_ns;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+typedef struct TBStatsSnapshot {
+    TBStatistics stats;
+    uint64_t key;
+} TBStatsSnapshot;
+
+typedef struct TBStatsCollect {
+    GArray *entries;
+    TbStatsSortBy sort_by;
+    uint64_t total_execs;
+    uint64_t total_insns;
+} TBStatsCollect;
+
+static void tb_stats_collect(void *p, uint32_t hash, void *userp)
+{
+    TBStatistics *s = p;
+    TBStatsCollect *c = userp;
+    TBStatsSnapshot snap;
+
+    qemu_spin_lock(&s->lock);
+    snap.stats = *s;
+    qemu_spin_unlock(&s->lock);
+    snap.stats.executions = qatomic_read__nocheck(&s->executions);
+    snap.key = tb_stats_key(&snap.stats, c->sort_by);
+
+    c->total_execs += snap.stats.executions;
+    c->total_insns += snap.stats.executions * snap.stats.guest_insns;
+    g_array_append_val(c->entries, snap);
+}
+
+static gint tb_stats_snapshot_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TBStatsSnapshot *a = ap;
+    const TBStatsSnapshot *b = bp;
+
+    /* hottest first */
+    return a->key < b->key ? 1 : a->key > b->key ? -1 : 0;
+}
+
+void tb_stats_dump(GString *buf, size_t max, TbStatsSortBy sort_by)
+{
+    TBStatsCollect c = {
+        .entries = g_array_new(false, false, sizeof(TBStatsSnapshot)),
+        .sort_by = sort_by,
+    };
+    size_t i;
+
+    qht_iter(&tb_stats_ht, tb_stats_collect, &c);
+    g_array_sort(c.entries, tb_stats_snapshot_cmp);
+
+    g_string_append_printf(buf, "%u blocks, %" PRIu64 " executions, "
+                           "~%" PRIu64 " guest instructions\n",
+                           c.entries->len, c.total_execs, c.total_insns);
+    g_string_append_printf(buf, "%-18s %-18s %-10s %12s %7s %5s %5s %6s %6s"
+                           " %8s %-18s\n", "phys_pc", "pc", "cflags",
+                           "execs", "%insns", "insns", "host", "spills",
+                           "xlat", "xlat_us", "host_pc");
+
+    for (i = 0; i < MIN(max, c.entries->len); i++) {
+        const TBStatsSnapshot *e =
+            &g_array_index(c.entries, TBStatsSnapshot, i);
+        const TBStatistics *s = &e->stats;
+        uint64_t insns = s->executions * s->guest_insns;
+
+        g_string_append_printf(buf, "0x%016" PRIx64 " 0x%016" PRIx64
+                               " 0x%08" PRIx32 " %12" PRIu64
+                               " %6.2f%% %5u %5u %6u %6" PRIu64
+                               " %8" PRIu64 " %p\n",
+                               (uint64_t)s->phys_pc, (uint64_t)s->pc,
+                               s->cflags, s->executions,
+                               c.total_insns ?
+                               insns * 100.0 / c.total_insns : 0.0,
+                               s->guest_insns, s->host_size, s->spills,
+                               s->translations, s->translate_ns / 1000,
+                               s->host_pc);
+    }
+    g_array_free(c.entries, true);
+}
+
+static void tb_stats_count(void *p, uint32_t hash, void *userp)
+{
+    size_t *n = userp;
+
+    (*n)++;
+}
+
+void tb_stats_dump_info(GString *buf)
+{
+    size_t n = 0;
+
+    if (!tcg_tb_stats) {
+        return;
+    }
+    qht_iter(&tb_stats_ht, tb_stats_count, &n);
+    g_string_append_printf(buf, "TB statistics       %zu blocks tracked\n", n);
+}
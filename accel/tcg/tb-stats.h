@@ -0,0 +1,63 @@
+/*
+ * Per translation block execution statistics.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_STATS_H
+#define ACCEL_TCG_TB_STATS_H
+
+#include "qemu/thread.h"
+#include "qapi/qapi-types-machine.h"
+
+/*
+ * Statistics of the guest code at a given physical and virtual address,
+ * translated with given flags and cflags, kept across retranslations and
+ * flushes of the code buffer.  Entries
+ * are never freed, so that generated code may increment @executions
+ * without holding a reference.
+ */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+
+    /* Incremented by the generated code, without atomics. */
+    uint64_t executions;
+
+    QemuSpin lock;
+    uint64_t translations;
+    uint64_t translate_ns;
+    /* The following describe the latest translation. */
+    uint32_t guest_insns;
+    uint32_t host_size;
+    uint32_t spills;
+    const void *host_pc;
+} TBStatistics;
+
+/* Set if -accel tcg,tb-stats=on */
+extern bool tcg_tb_stats;
+
+void tb_stats_init(void);
+
+/* Find or create the statistics entry for a block. */
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags,
+                           uint32_t cflags);
+
+/*
+ * Account for the translation of @tb, which took @ns nanoseconds and
+ * spilled @spills registers.
+ */
+void tb_stats_translated(const TranslationBlock *tb, int64_t ns,
+                         unsigned spills);
+
+/* Append the @max hottest blocks according to @sort_by to @buf. */
+void tb_stats_dump(GString *buf, size_t max, TbStatsSortBy sort_by);
+
+/* Append a summary to @buf, for 'info jit'. */
+void tb_stats_dump_info(GString *buf);
+
+#endif /* ACCEL_TCG_TB_STATS_H */
@@ -134,6 +134,181 @@ void icount_process_data(CPUState *cpu)
     replay_mutex_unlock();
 }
 
+/*
+ * Parallel icount
+ *
+ * With -icount quantum=N each vCPU has its own thread.  Every vCPU runs
+ * the same number of instructions (the quantum, cut short at the next
+ * QEMU_CLOCK_VIRTUAL deadline) and then waits for the others.  The last
+ * one to finish moves the clock forward and runs the expired timers, so
+ * virtual time and timer delivery only depend on instruction counts and
+ * not on how the host schedules the threads.  A halted vCPU does not
+ * hold the others back; when they are all halted the clock jumps to the
+ * next deadline, as with sleep=off.
+ *
+ * Which vCPUs take part in a quantum is decided at its start, after the
+ * expired timers ran: a vCPU woken up in the middle of a quantum, by an
+ * IPI for example, waits for the next one.  Otherwise it would join the
+ * current quantum or the next depending on how soon its thread runs.
+ *
+ * All of the state below is protected by the BQL, and a vCPU waiting
+ * for the end of the quantum sleeps on its halt_cond so that kicks and
+ * stop requests still reach it.
+ */
+enum {
+    ICOUNT_QUANTUM_IDLE,        /* halted or stopped, not waited for */
+    ICOUNT_QUANTUM_RUNNING,     /* owes instructions to this quantum */
+    ICOUNT_QUANTUM_DONE,        /* waiting for the next quantum */
+};
+
+static int64_t quantum_len;
+static unsigned quantum_pending;
+
+static int64_t icount_quantum_limit(void)
+{
+    int64_t deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                                  QEMU_TIMER_ATTR_ALL);
+
+    if (deadline < 0) {
+        return icount_quantum;
+    }
+    return MAX(1, MIN(icount_quantum, icount_round(deadline)));
+}
+
+/*
+ * Start a quantum with every vCPU that can run, whether it finished the
+ * previous quantum or has just been woken up.
+ */
+static void icount_quantum_enroll(void)
+{
+    CPUState *cpu;
+
+    quantum_len = icount_quantum_limit();
+    CPU_FOREACH(cpu) {
+        if (cpu->unplug || cpu_thread_is_idle(cpu)) {
+            /* the thread is going away or sleeping, don't wait for it */
+            cpu->icount_quantum_state = ICOUNT_QUANTUM_IDLE;
+            continue;
+        }
+        cpu->icount_quantum_state = ICOUNT_QUANTUM_RUNNING;
+        quantum_pending++;
+        qemu_cond_broadcast(cpu->halt_cond);
+    }
+}
+
+static void icount_quantum_advance(void)
+{
+    CPUState *cpu;
+    int64_t elapsed = 0;
+    bool busy = false, paused = false;
+
+    CPU_FOREACH(cpu) {
+        /* including vCPUs woken up whose thread has not noticed yet */
+        busy |= cpu->icount_quantum_state == ICOUNT_QUANTUM_DONE ||
+            (!cpu->unplug && !cpu_thread_is_idle(cpu));
+        paused |= cpu->stop || cpu->stopped;
+        elapsed = MAX(elapsed, cpu->icount_quantum_done);
+    }
+
+    /* Everybody went idle because the VM is stopping: resume later */
+    if (!busy && paused) {
+        return;
+    }
+
+    icount_advance(elapsed);
+    CPU_FOREACH(cpu) {
+        cpu->icount_quantum_done = 0;
+    }
+    if (!busy) {
+        int64_t deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                                      QEMU_TIMER_ATTR_ALL);
+        if (deadline > 0) {
+            icount_advance(icount_round(deadline));
+        }
+    }
+    icount_notify_aio_contexts();
+    icount_quantum_enroll();
+}
+
+/* Called with the BQL held; returns true if @cpu may run */
+bool icount_quantum_start(CPUState *cpu)
+{
+    if (cpu->icount_quantum_state == ICOUNT_QUANTUM_IDLE) {
+        if (quantum_pending == 0) {
+            /* Nobody is running: this is a quantum boundary too. */
+            icount_quantum_enroll();
+        } else {
+            /* Woken up in the middle of a quantum: wait for the next. */
+            cpu->icount_quantum_state = ICOUNT_QUANTUM_DONE;
+        }
+    }
+    return cpu->icount_quantum_state == ICOUNT_QUANTUM_RUNNING &&
+        cpu->icount_quantum_done < quantum_len;
+}
+
+/*
+ * Called with the BQL held after @cpu has run: leave the quantum if the
+ * budget is used up or the vCPU is about to sleep, and wait for the
+ * other vCPUs in the former case.
+ */
+void icount_quantum_end(CPUState *cpu)
+{
+    if (cpu->icount_quantum_state == ICOUNT_QUANTUM_RUNNING) {
+        if (cpu->icount_quantum_done >= quantum_len) {
+            cpu->icount_quantum_state = ICOUNT_QUANTUM_DONE;
+        } else if (cpu_thread_is_idle(cpu) || cpu->unplug) {
+            cpu->icount_quantum_state = ICOUNT_QUANTUM_IDLE;
+        } else {
+            return;
+        }
+        if (--quantum_pending == 0) {
+            icount_quantum_advance();
+        }
+    }
+
+    while (cpu->icount_quantum_state == ICOUNT_QUANTUM_DONE &&
+           cpu_can_run(cpu) && cpu_work_list_empty(cpu)) {
+        qemu_cond_wait_iothread(cpu->halt_cond);
+    }
+}
+
+void icount_quantum_prepare_for_run(CPUState *cpu)
+{
+    int insns_left;
+
+    g_assert(cpu_neg(cpu)->icount_decr.u16.low == 0);
+    g_assert(cpu->icount_extra == 0);
+
+    /* quantum_len cannot change while this vCPU is running */
+    cpu->icount_budget = quantum_len - cpu->icount_quantum_done;
+    insns_left = MIN(0xffff, cpu->icount_budget);
+    cpu_neg(cpu)->icount_decr.u16.low = insns_left;
+    cpu->icount_extra = cpu->icount_budget - insns_left;
+}
+
+/*
+ * cpu_exec_step_atomic runs a single instruction; give it a budget of
+ * one, still charged to the quantum, or its TB would exit before doing
+ * anything and the vCPU would raise EXCP_ATOMIC forever.
+ */
+void icount_quantum_prepare_for_step(CPUState *cpu)
+{
+    g_assert(cpu_neg(cpu)->icount_decr.u16.low == 0);
+    g_assert(cpu->icount_extra == 0);
+
+    cpu->icount_budget = MIN(1, quantum_len - cpu->icount_quantum_done);
+    cpu_neg(cpu)->icount_decr.u16.low = cpu->icount_budget;
+}
+
+void icount_quantum_process_data(CPUState *cpu)
+{
+    icount_update(cpu);
+
+    cpu_neg(cpu)->icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+}
+
 void icount_handle_interrupt(CPUState *cpu, int mask)
 {
     int old_mask = cpu->interrupt_request;
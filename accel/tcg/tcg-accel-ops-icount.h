@@ -14,6 +14,12 @@ void icount_handle_deadline(void);
 void icount_prepare_for_run(CPUState *cpu);
 void icount_process_data(CPUState *cpu);
 
+bool icount_quantum_start(CPUState *cpu);
+void icount_quantum_end(CPUState *cpu);
+void icount_quantum_prepare_for_run(CPUState *cpu);
+void icount_quantum_prepare_for_step(CPUState *cpu);
+void icount_quantum_process_data(CPUState *cpu);
+
 void icount_handle_interrupt(CPUState *cpu, int mask);
 
 #endif /* TCG_ACCEL_OPS_ICOUNT_H */
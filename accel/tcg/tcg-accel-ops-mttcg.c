@@ -35,6 +35,7 @@
 
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-mttcg.h"
+#include "tcg-accel-ops-icount.h"
 
 typedef struct MttcgForceRcuNotifier {
     Notifier notifier;
@@ -68,7 +69,7 @@ static void *mttcg_cpu_thread_fn(void *arg)
     CPUState *cpu = arg;
 
     assert(tcg_enabled());
-    g_assert(!icount_enabled());
+    g_assert(!icount_enabled() || icount_parallel());
 
     rcu_register_thread();
     force_rcu.notifier.notify = mttcg_force_rcu;
@@ -89,10 +90,17 @@ static void *mttcg_cpu_thread_fn(void *arg)
     cpu->exit_request = 1;
 
     do {
-        if (cpu_can_run(cpu)) {
+        if (cpu_can_run(cpu) &&
+            (!icount_enabled() || icount_quantum_start(cpu))) {
             int r;
             qemu_mutex_unlock_iothread();
+            if (icount_enabled()) {
+                icount_quantum_prepare_for_run(cpu);
+            }
             r = tcg_cpus_exec(cpu);
+            if (icount_enabled()) {
+                icount_quantum_process_data(cpu);
+            }
             qemu_mutex_lock_iothread();
             switch (r) {
             case EXCP_DEBUG:
@@ -111,7 +119,13 @@ static void *mttcg_cpu_thread_fn(void *arg)
                 break;
             case EXCP_ATOMIC:
                 qemu_mutex_unlock_iothread();
+                if (icount_enabled()) {
+                    icount_quantum_prepare_for_step(cpu);
+                }
                 cpu_exec_step_atomic(cpu);
+                if (icount_enabled()) {
+                    icount_quantum_process_data(cpu);
+                }
                 qemu_mutex_lock_iothread();
             default:
                 /* Ignore everything else? */
@@ -119,6 +133,10 @@ static void *mttcg_cpu_thread_fn(void *arg)
             }
         }
 
+        if (icount_enabled()) {
+            icount_quantum_end(cpu);
+        }
+
         qatomic_mb_set(&cpu->exit_request, 0);
         qemu_wait_io_event(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
@@ -37,6 +37,8 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "tb-profile.h"
+#include "tb-stats.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -44,6 +46,13 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_profile;
+    uint32_t tier_threshold;
+    bool tb_prefetch;
+    bool ibtc;
+    bool ras;
+    bool regalloc_tb;
+    bool tb_stats;
 };
 typedef struct TCGState TCGState;
 
@@ -83,7 +92,7 @@ static bool check_tcg_memory_orders_compatible(void)
 
 static bool default_mttcg_enabled(void)
 {
-    if (icount_enabled() || TCG_OVERSIZED_GUEST) {
+    if ((icount_enabled() && !icount_parallel()) || TCG_OVERSIZED_GUEST) {
         return false;
     } else {
 #ifdef TARGET_SUPPORTS_MTTCG
@@ -109,6 +118,10 @@ static void tcg_accel_instance_init(Object *obj)
 }
 
 bool mttcg_enabled;
+unsigned int tcg_tier_threshold;
+bool tcg_tb_prefetch;
+bool tcg_ibtc;
+bool tcg_ras;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -119,13 +132,32 @@ static int tcg_init_machine(MachineState *ms)
     unsigned max_cpus = ms->smp.max_cpus;
 #endif
 
+#ifndef CONFIG_USER_ONLY
+    if (icount_parallel() && !s->mttcg_enabled) {
+        error_report("icount quantum requires thread=multi");
+        return -EINVAL;
+    }
+#endif
+
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tcg_tier_threshold = s->tier_threshold;
+    tcg_tb_prefetch = s->tb_prefetch;
+    tcg_ibtc = s->ibtc;
+    tcg_ras = s->ras;
+    tcg_regalloc_tb = s->regalloc_tb;
 
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
 
+    if (s->tb_profile) {
+        tb_profile_init(s->tb_profile);
+    }
+    if (s->tb_stats) {
+        tb_stats_init();
+    }
+
 #if defined(CONFIG_SOFTMMU)
     /*
      * There's no guest base to take into account, so go ahead and
@@ -151,8 +183,9 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (icount_enabled()) {
-            error_setg(errp, "No MTTCG when icount is enabled");
+        } else if (icount_enabled() && !icount_parallel()) {
+            error_setg(errp, "No MTTCG when icount is enabled "
+                       "without a quantum");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
             warn_report("Guest not yet converted to MTTCG - "
@@ -208,6 +241,117 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static char *tcg_get_tb_profile(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_profile);
+}
+
+static void tcg_set_tb_profile(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_profile);
+    s->tb_profile = g_strdup(value);
+}
+
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > INT32_MAX) {
+        error_setg(errp, "tier-threshold must be at most %d", INT32_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+}
+
+static bool tcg_get_tb_prefetch(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_prefetch;
+}
+
+static void tcg_set_tb_prefetch(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_prefetch = value;
+}
+
+static bool tcg_get_ibtc(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->ibtc;
+}
+
+static void tcg_set_ibtc(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->ibtc = value;
+}
+
+static bool tcg_get_ras(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->ras;
+}
+
+static void tcg_set_ras(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->ras = value;
+}
+
+static char *tcg_get_regalloc(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->regalloc_tb ? "tb" : "bb");
+}
+
+static void tcg_set_regalloc(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (strcmp(value, "tb") == 0) {
+        s->regalloc_tb = true;
+    } else if (strcmp(value, "bb") == 0) {
+        s->regalloc_tb = false;
+    } else {
+        error_setg(errp, "Invalid 'regalloc' setting %s", value);
+    }
+}
+
+static bool tcg_get_tb_stats(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_stats;
+}
+
+static void tcg_set_tb_stats(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_stats = value;
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -245,6 +389,44 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_str(oc, "tb-profile",
+        tcg_get_tb_profile, tcg_set_tb_profile);
+    object_class_property_set_description(oc, "tb-profile",
+        "File used to record and replay the set of translated blocks");
+
+    object_class_property_add(oc, "tier-threshold", "int",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions of a translation block before it is optimized "
+        "(0 to always optimize)");
+
+    object_class_property_add_bool(oc, "tb-prefetch",
+        tcg_get_tb_prefetch, tcg_set_tb_prefetch);
+    object_class_property_set_description(oc, "tb-prefetch",
+        "Translate the direct successors of new translation blocks");
+
+    object_class_property_add_bool(oc, "ibtc",
+        tcg_get_ibtc, tcg_set_ibtc);
+    object_class_property_set_description(oc, "ibtc",
+        "Predict the targets of indirect branches inline");
+
+    object_class_property_add_bool(oc, "ras",
+        tcg_get_ras, tcg_set_ras);
+    object_class_property_set_description(oc, "ras",
+        "Predict the targets of function returns with a return stack");
+
+    object_class_property_add_str(oc, "regalloc",
+        tcg_get_regalloc, tcg_set_regalloc);
+    object_class_property_set_description(oc, "regalloc",
+        "Keep guest registers in host registers within a basic block "
+        "(bb) or across the forward branches of a translation block (tb)");
+
+    object_class_property_add_bool(oc, "tb-stats",
+        tcg_get_tb_stats, tcg_set_tb_stats);
+    object_class_property_set_description(oc, "tb-stats",
+        "Count the executions of each translation block");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -63,6 +63,8 @@
 #include "tb-context.h"
 #include "internal.h"
 #include "perf.h"
+#include "tb-profile.h"
+#include "tb-stats.h"
 
 /* Make sure all possible CPU event bits fit in tb->trace_vcpu_dstate */
 QEMU_BUILD_BUG_ON(CPU_TRACE_DSTATE_MAX_EVENTS >
@@ -296,10 +298,38 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              target_ulong pc, target_ulong cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Translate the destinations of the direct jumps out of @tb, just
+ * generated for @pc, so that the cpu finds them already translated.
+ */
+static void tb_prefetch_successors(CPUState *cpu, TranslationBlock *tb,
+                                   target_ulong pc)
+{
+    target_ulong succ[ARRAY_SIZE(tcg_ctx->gen_succ)];
+    int i, n;
+
+    if (!tcg_tb_prefetch) {
+        return;
+    }
+
+    /* Each translation below overwrites gen_succ. */
+    n = tcg_ctx->gen_nb_succ;
+    memcpy(succ, tcg_ctx->gen_succ, sizeof(succ));
+    for (i = 0; i < n; i++) {
+        tb_prefetch(cpu, tb, pc, succ[i]);
+    }
+}
+
+/*
+ * Generate a TB that is retranslated after @tier_count executions,
+ * or a hot TB if @tier_count is zero.
+ * Called with mmap_lock held for user mode emulation.
+ */
+static TranslationBlock *tb_gen_code_tier(CPUState *cpu,
+                                          target_ulong pc,
+                                          target_ulong cs_base,
+                                          uint32_t flags, int cflags,
+                                          int tier_count)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb, *existing_tb;
@@ -309,7 +339,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
 #endif
-    int64_t ti;
+    int64_t ti, xlat_start = 0;
     void *host_pc;
 
     assert_memory_lock();
@@ -318,8 +348,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
 
     if (phys_pc == -1) {
+        if (tcg_ctx->gen_speculative) {
+            return NULL;
+        }
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | CF_LAST_IO | 1;
+        tier_count = 0;
     }
 
     max_insns = cflags & CF_COUNT_MASK;
@@ -331,8 +365,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* Never flush on behalf of a block that may not be executed. */
+        if (tcg_ctx->gen_speculative) {
+            return NULL;
+        }
+        /* eviction or flush must be done */
+        tb_reclaim(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -348,8 +386,15 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tier_count = tier_count;
+    tb->prefetched = tcg_ctx->gen_speculative;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
+    tb->tb_stats = NULL;
+    if (tcg_tb_stats && phys_pc != -1) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags, cflags);
+        xlat_start = get_clock();
+    }
     tcg_ctx->gen_tb = tb;
  tb_overflow:
 
@@ -397,6 +442,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                           max_insns);
             goto tb_overflow;
 
+        case -3:
+            /*
+             * A speculative translation needed to access a second page.
+             * Release the space reserved for the TranslationBlock.
+             */
+            qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
+                        ((uintptr_t)gen_code_buf -
+                         ROUND_UP(sizeof(*tb), qemu_icache_linesize)));
+            return NULL;
+
         default:
             g_assert_not_reached();
         }
@@ -407,6 +462,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->tb_stats) {
+        tb_stats_translated(tb, get_clock() - xlat_start,
+                            tcg_ctx->spill_count);
+    }
+
     /*
      * For TARGET_TB_PCREL, attribute all executions of the generated
      * code to its first mapping.
@@ -545,9 +605,89 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+
+    if (!tcg_ctx->gen_speculative) {
+        tb_profile_translated(cpu, tb, pc, host_pc);
+        tb_prefetch_successors(cpu, tb, pc);
+    }
     return tb;
 }
 
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, int cflags)
+{
+    return tb_gen_code_tier(cpu, pc, cs_base, flags, cflags,
+                            tcg_tier_threshold);
+}
+
+/*
+ * Retranslate the cold block @tb, executed at @pc, with all optimizations.
+ * Called with mmap_lock held for user mode emulation.
+ */
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             target_ulong pc)
+{
+    /*
+     * The hot TB compares equal to the cold one, which must therefore
+     * leave the hash table first.  In between, other cpus may finish
+     * executing the cold TB, or translate a cold copy of their own.
+     */
+    tb_phys_invalidate(tb, -1);
+    qatomic_inc(&tb_ctx.tb_tier_up_count);
+
+    return tb_gen_code_tier(cpu, pc, tb->cs_base, tb->flags,
+                            tb_cflags(tb) & ~CF_INVALID, 0);
+}
+
+/*
+ * Translate the block at @pc before it is first executed, on behalf of
+ * @tb, which was just generated for @tb_vaddr.  The new block is given
+ * the cs_base, flags and cflags of @tb, which are only known to match
+ * the cpu state if the block is on the same guest page and the cpu
+ * state has not changed in between.
+ *
+ * Returns true if a new block was generated.
+ */
+bool tb_prefetch(CPUState *cpu, const TranslationBlock *tb,
+                 target_ulong tb_vaddr, target_ulong pc)
+{
+    CPUArchState *env = cpu->env_ptr;
+    TranslationBlock *new_tb;
+    uint32_t cflags = tb_cflags(tb);
+    void *host;
+
+    if (pc == tb_vaddr ||
+        ((pc ^ tb_vaddr) & TARGET_PAGE_MASK) != 0 ||
+        cflags != curr_cflags(cpu) ||
+        tcg_ctx->gen_speculative) {
+        return false;
+    }
+    if (tb_htable_lookup(cpu, pc, tb->cs_base, tb->flags, cflags)) {
+        return false;
+    }
+    /*
+     * The guest has not fetched from @pc: a fault there must not be
+     * raised, nor longjmp out of the translation below.  Fill the TLB
+     * without faulting, so that tb_gen_code finds the page.
+     */
+    if (probe_access_flags(env, pc, MMU_INST_FETCH, cpu_mmu_index(env, true),
+                           true, &host, 0) & TLB_INVALID_MASK) {
+        return false;
+    }
+
+    tcg_ctx->gen_speculative = true;
+    new_tb = tb_gen_code(cpu, pc, tb->cs_base, tb->flags, cflags);
+    tcg_ctx->gen_speculative = false;
+
+    if (new_tb == NULL) {
+        return false;
+    }
+    qatomic_inc(&tb_ctx.tb_prefetch_count);
+    return true;
+}
+
 /* user-mode: call with mmap_lock held */
 void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
 {
@@ -706,7 +846,13 @@ void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, flush_large,
+           flush_coalesced;
+    uint64_t jc_hits, jc_victim_hits, jc_misses, ibtc_misses, ras_misses;
+    uint64_t excl_steps, excl_ns;
+    size_t jc_entries;
+    unsigned prefetched;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -745,13 +891,65 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    if (tcg_tier_threshold) {
+        g_string_append_printf(buf, "TB tier-up count    %u\n",
+                               qatomic_read(&tb_ctx.tb_tier_up_count));
+        g_string_append_printf(buf, "TB superblocks      %u "
+                               "(%u jumps followed)\n",
+                               qatomic_read(&tb_ctx.tb_superblock_count),
+                               qatomic_read(&tb_ctx.tb_jumps_followed));
+    }
+    prefetched = qatomic_read(&tb_ctx.tb_prefetch_count);
+    if (prefetched) {
+        unsigned hits = qatomic_read(&tb_ctx.tb_prefetch_hit_count);
+
+        g_string_append_printf(buf, "TB prefetch count   %u "
+                               "(%u executed, %u unused)\n",
+                               prefetched, hits, prefetched - hits);
+    }
+    tb_profile_dump_info(buf);
+    tb_stats_dump_info(buf);
+
+    jc_hits = jc_victim_hits = jc_misses = ibtc_misses = ras_misses = 0;
+    jc_entries = 0;
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+            jc_hits += jc->hits;
+            jc_victim_hits += jc->victim_hits;
+            jc_misses += jc->misses;
+            jc_entries += jc->mask + 1;
+            ibtc_misses += jc->ibtc_misses;
+            ras_misses += jc->ras_misses;
+        }
+    }
+    g_string_append_printf(buf, "TB jmp cache        %" PRIu64 " hits, %"
+                           PRIu64 " victim hits, %" PRIu64 " misses, "
+                           "%zu entries\n",
+                           jc_hits, jc_victim_hits, jc_misses, jc_entries);
+    if (tcg_ibtc || tcg_ras) {
+        g_string_append_printf(buf, "Mispredicted jumps  %" PRIu64
+                               " indirect, %" PRIu64 " returns\n",
+                               ibtc_misses, ras_misses);
+    }
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tcg_exclusive_stats(&excl_steps, &excl_ns);
+    g_string_append_printf(buf, "Exclusive steps     %" PRIu64 ", %" PRIu64
+                           " us total\n", excl_steps, excl_ns / 1000);
+
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_large,
+                     &flush_coalesced);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB large flushes   %zu\n", flush_large);
+    g_string_append_printf(buf, "TLB coalesced flushes %zu\n",
+                           flush_coalesced);
     tcg_dump_info(buf);
 }
 
@@ -772,16 +970,23 @@ void cpu_interrupt(CPUState *cpu, int mask)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+
+    RCU_READ_LOCK_GUARD();
 
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (unsigned int i = 0; i <= jc->mask; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    for (int i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i].tb, NULL);
+    }
+    tb_jmp_cache_clear_branches(jc);
 }
 
 /* This is a wrapper for common code that can not use CONFIG_SOFTMMU */
@@ -17,6 +17,10 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "internal.h"
+#include "tb-context.h"
+#include "tb-hash.h"
+#include "tb-stats.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -39,7 +43,201 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
+    if (((db->pc_first ^ dest) & TARGET_PAGE_MASK) != 0) {
+        return false;
+    }
+
+    /* Record the successor as a candidate for translation ahead. */
+    if (tcg_ctx->gen_nb_succ < ARRAY_SIZE(tcg_ctx->gen_succ)) {
+        tcg_ctx->gen_succ[tcg_ctx->gen_nb_succ++] = dest;
+    }
+    return true;
+}
+
+bool translator_follow_jump(DisasContextBase *db, target_ulong dest)
+{
+    /*
+     * Superblocks are formed only when a block is retranslated because
+     * it was found to be hot.
+     */
+    if (!tcg_tier_threshold || tb_is_cold(db->tb) ||
+        (tb_cflags(db->tb) & CF_NO_GOTO_TB)) {
+        return false;
+    }
+
+    /*
+     * Code invalidation considers the range [pc_first, pc_first + size)
+     * of a TB.  It covers every instruction of the superblock as long
+     * as jumps go forward, without leaving the page of the TB.
+     */
+    if (dest <= db->pc_next || !is_same_page(db, dest)) {
+        return false;
+    }
+
+    db->num_jumps_followed++;
+    return true;
+}
+
+/*
+ * Return true if the inline branch caches may be used.  A TB executing
+ * a bounded number of instructions is not expected to be chained to.
+ */
+static bool translator_use_branch_cache(DisasContextBase *db)
+{
+    return !(tb_cflags(db->tb) & (CF_NO_GOTO_TB | CF_NO_GOTO_PTR |
+                                  CF_COUNT_MASK));
+}
+
+static void gen_load_jmp_cache(TCGv_ptr jc)
+{
+    tcg_gen_ld_ptr(jc, cpu_env, offsetof(ArchCPU, parent_obj.tb_jmp_cache) -
+                   offsetof(ArchCPU, env));
+}
+
+/*
+ * Jump to the TB in @tb, which was predicted for @dest by the entry at
+ * @ofs of the jump cache @jc, if it is valid and matches the current TB.
+ * Otherwise fall through.
+ */
+static void gen_goto_predicted_tb(DisasContextBase *db, TCGv dest,
+                                  TCGv_ptr jc, intptr_t ofs)
+{
+    TranslationBlock *cur = db->tb;
+    TCGLabel *miss = gen_new_label();
+    TCGv_ptr tb = tcg_temp_local_new_ptr();
+    TCGv t = tcg_temp_new();
+    TCGv_i32 t32;
+
+    tcg_gen_ld_tl(t, jc, ofs + offsetof(CPUBranchCacheEntry, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, t, dest, miss);
+    tcg_temp_free(t);
+    tcg_gen_ld_ptr(tb, jc, ofs + offsetof(CPUBranchCacheEntry, tb));
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, tb, 0, miss);
+
+    /* This also checks that the predicted TB has not been invalidated. */
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, cflags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb_cflags(cur), miss);
+    tcg_temp_free_i32(t32);
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, tb, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, cur->flags, miss);
+    tcg_temp_free_i32(t32);
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, tb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, t, cur->cs_base, miss);
+    tcg_temp_free(t);
+
+    tcg_gen_ld_ptr(tb, tb, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(tb));
+    tcg_temp_free_ptr(tb);
+    gen_set_label(miss);
+}
+
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv dest,
+                                    bool is_return)
+{
+    TCGv_ptr jc, ptr;
+
+    if (!(is_return ? tcg_ras : tcg_ibtc) ||
+        !translator_use_branch_cache(db)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    jc = tcg_temp_local_new_ptr();
+    gen_load_jmp_cache(jc);
+    ptr = tcg_temp_new_ptr();
+
+    if (is_return) {
+        TCGv_i32 top = tcg_temp_new_i32();
+        TCGv_i32 t32 = tcg_temp_new_i32();
+        TCGv_ptr e = tcg_temp_local_new_ptr();
+
+        /* Pop the top of the stack, whether or not it is right. */
+        tcg_gen_ld_i32(top, jc, offsetof(CPUJumpCache, ras_top));
+        tcg_gen_subi_i32(t32, top, 1);
+        tcg_gen_andi_i32(t32, t32, TB_JMP_RAS_SIZE - 1);
+        tcg_gen_st_i32(t32, jc, offsetof(CPUJumpCache, ras_top));
+        tcg_temp_free_i32(t32);
+
+        tcg_gen_muli_i32(top, top, sizeof(CPUBranchCacheEntry));
+        tcg_gen_ext_i32_ptr(e, top);
+        tcg_gen_add_ptr(e, e, jc);
+        tcg_temp_free_i32(top);
+        gen_goto_predicted_tb(db, dest, e, offsetof(CPUJumpCache, ras));
+        tcg_temp_free_ptr(e);
+
+        gen_helper_lookup_tb_ptr_ret(ptr, cpu_env);
+    } else {
+        unsigned int idx = tb_jmp_ibtc_hash(db->pc_next);
+
+        gen_goto_predicted_tb(db, dest, jc, offsetof(CPUJumpCache, ibtc) +
+                              idx * sizeof(CPUBranchCacheEntry));
+        gen_helper_lookup_tb_ptr_ibtc(ptr, cpu_env, tcg_constant_i32(idx));
+    }
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_ptr(jc);
+}
+
+void translator_push_return(DisasContextBase *db, target_ulong ret)
+{
+    TCGLabel *done;
+    TCGv_ptr jc, e;
+    TCGv_i32 top;
+    TCGv t;
+
+    if (!tcg_ras || !translator_use_branch_cache(db)) {
+        return;
+    }
+
+    jc = tcg_temp_new_ptr();
+    gen_load_jmp_cache(jc);
+    top = tcg_temp_new_i32();
+    tcg_gen_ld_i32(top, jc, offsetof(CPUJumpCache, ras_top));
+    tcg_gen_addi_i32(top, top, 1);
+    tcg_gen_andi_i32(top, top, TB_JMP_RAS_SIZE - 1);
+    tcg_gen_st_i32(top, jc, offsetof(CPUJumpCache, ras_top));
+
+    e = tcg_temp_local_new_ptr();
+    tcg_gen_muli_i32(top, top, sizeof(CPUBranchCacheEntry));
+    tcg_gen_ext_i32_ptr(e, top);
+    tcg_gen_add_ptr(e, e, jc);
+    tcg_temp_free_i32(top);
+    tcg_temp_free_ptr(jc);
+
+    /*
+     * The same call usually pushes the same return address at the same
+     * depth: keep the TB found by the previous return through this entry.
+     */
+    done = gen_new_label();
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, e, offsetof(CPUJumpCache, ras) +
+                  offsetof(CPUBranchCacheEntry, pc));
+    tcg_gen_brcondi_tl(TCG_COND_EQ, t, ret, done);
+    tcg_temp_free(t);
+    tcg_gen_st_ptr(tcg_constant_ptr(0), e, offsetof(CPUJumpCache, ras) +
+                   offsetof(CPUBranchCacheEntry, tb));
+    tcg_gen_st_tl(tcg_constant_tl(ret), e, offsetof(CPUJumpCache, ras) +
+                  offsetof(CPUBranchCacheEntry, pc));
+    gen_set_label(done);
+    tcg_temp_free_ptr(e);
+}
+
+/* Count the executions of @tb in its statistics entry. */
+static void gen_tb_stats_exec(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_i64 t = tcg_temp_new_i64();
+
+    tcg_gen_movi_ptr(ptr, (intptr_t)&tb->tb_stats->executions);
+    tcg_gen_ld_i64(t, ptr, 0);
+    tcg_gen_addi_i64(t, t, 1);
+    tcg_gen_st_i64(t, ptr, 0);
+    tcg_temp_free_i64(t);
+    tcg_temp_free_ptr(ptr);
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int max_insns,
@@ -57,6 +255,8 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int max_insns,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->num_jumps_followed = 0;
+    tcg_ctx->gen_nb_succ = 0;
     db->host_addr[0] = host_pc;
     db->host_addr[1] = NULL;
 
@@ -72,6 +272,9 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int max_insns,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (tb->tb_stats) {
+        gen_tb_stats_exec(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -138,6 +341,11 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int max_insns,
     tb->size = db->pc_next - db->pc_first;
     tb->icount = db->num_insns;
 
+    if (db->num_jumps_followed) {
+        qatomic_inc(&tb_ctx.tb_superblock_count);
+        qatomic_add(&tb_ctx.tb_jumps_followed, db->num_jumps_followed);
+    }
+
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
         && qemu_log_in_addr_range(db->pc_first)) {
@@ -174,8 +382,17 @@ static void *translator_access(CPUArchState *env, DisasContextBase *db,
         host = db->host_addr[1];
         base = TARGET_PAGE_ALIGN(db->pc_first);
         if (host == NULL) {
-            tb_page_addr_t phys_page =
-                get_page_addr_code_hostp(env, base, &db->host_addr[1]);
+            tb_page_addr_t phys_page;
+
+            /*
+             * A block translated ahead of its execution must not fault
+             * on a page the guest has not yet fetched from: abandon it.
+             */
+            if (tcg_ctx->gen_speculative) {
+                siglongjmp(tcg_ctx->jmp_trans, -3);
+            }
+            phys_page = get_page_addr_code_hostp(env, base,
+                                                 &db->host_addr[1]);
             /* We cannot handle MMIO as second page. */
             assert(phys_page != -1);
             tb_set_page_addr1(tb, phys_page);
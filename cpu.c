@@ -346,6 +346,11 @@ int cpu_breakpoint_insert(CPUState *cpu, vaddr pc, int flags,
         *breakpoint = bp;
     }
 
+    /* Targets predicted inline for indirect branches skip the check. */
+    if (tcg_enabled()) {
+        tcg_flush_jmp_cache(cpu);
+    }
+
     trace_breakpoint_insert(cpu->cpu_index, pc, flags);
     return 0;
 }
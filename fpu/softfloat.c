@@ -241,6 +241,22 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Integers of at most @bits significant bits convert exactly to a
+ * format with a significand that wide, raising no flag in any rounding
+ * mode: such conversions need not wait for can_use_fpu.
+ */
+static inline bool hard_sint_is_exact(int64_t a, int bits)
+{
+    return !QEMU_NO_HARDFLOAT &&
+           a >= -(INT64_C(1) << bits) && a <= (INT64_C(1) << bits);
+}
+
+static inline bool hard_uint_is_exact(uint64_t a, int bits)
+{
+    return !QEMU_NO_HARDFLOAT && a <= (UINT64_C(1) << bits);
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -401,6 +417,80 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * Half precision operations are done with the single precision ones of
+ * the host.  The sum, difference, product, quotient and square root of
+ * binary16 numbers, rounded to binary32, round again to the binary16
+ * value of the exact result, since 24 >= 2 * 11 + 2.  The numbers are
+ * converted with integer operations, which only handle zeros and
+ * normals; results that overflow or may be tiny in binary16 go to
+ * softfloat, so that the only flag to raise is inexact, already set.
+ */
+typedef float16 (*soft_f16_op2_fn)(float16 a, float16 b, float_status *s);
+typedef bool (*f16_check_fn)(float16 a, float16 b);
+
+static inline bool f16_is_zon(float16 a)
+{
+    return float16_is_zero(a) || float16_is_normal(a);
+}
+
+static inline bool f16_is_zon2(float16 a, float16 b)
+{
+    return f16_is_zon(a) && f16_is_zon(b);
+}
+
+static inline float f16_to_host(float16 a)
+{
+    uint32_t h = float16_val(a);
+    uint32_t f = (h & 0x8000) << 16;
+    union_float32 u;
+
+    if (h & 0x7fff) {
+        f |= ((h & 0x7fff) << 13) + ((127 - 15) << 23);
+    }
+    u.s = make_float32(f);
+    return u.h;
+}
+
+static inline bool f16_from_host(float r, float16 *ret)
+{
+    union_float32 u;
+    uint32_t m;
+
+    u.h = r;
+    m = float32_val(u.s) & 0x7fffffff;
+    if (m != 0) {
+        if (unlikely(fabsf(r) < 0x1p-14f || fabsf(r) > 65504.0f)) {
+            return false;
+        }
+        /* rebias the exponent, then round to nearest even */
+        m -= (127 - 15) << 23;
+        m += 0xfff + ((m >> 13) & 1);
+    }
+    *ret = make_float16(((float32_val(u.s) >> 16) & 0x8000) | (m >> 13));
+    return true;
+}
+
+static inline float16
+float16_gen2(float16 a, float16 b, float_status *s,
+             hard_f32_op2_fn hard, soft_f16_op2_fn soft, f16_check_fn pre)
+{
+    float16 r;
+
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+    if (unlikely(!pre(a, b))) {
+        goto soft;
+    }
+    if (likely(f16_from_host(hard(f16_to_host(a), f16_to_host(b)), &r))) {
+        return r;
+    }
+
+ soft:
+    return soft(a, b, s);
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -1857,12 +1947,12 @@ float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
     return float16_round_pack_canonical(pr, status);
 }
 
-float16 float16_add(float16 a, float16 b, float_status *status)
+static float16 soft_f16_add(float16 a, float16 b, float_status *status)
 {
     return float16_addsub(a, b, status, false);
 }
 
-float16 float16_sub(float16 a, float16 b, float_status *status)
+static float16 soft_f16_sub(float16 a, float16 b, float_status *status)
 {
     return float16_addsub(a, b, status, true);
 }
@@ -1948,6 +2038,16 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
     }
 }
 
+float16 QEMU_FLATTEN float16_add(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_add, soft_f16_add, f16_is_zon2);
+}
+
+float16 QEMU_FLATTEN float16_sub(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_sub, soft_f16_sub, f16_is_zon2);
+}
+
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
                               hard_f32_op2_fn hard, soft_f32_op2_fn soft)
 {
@@ -2080,7 +2180,8 @@ floatx80 floatx80_sub(floatx80 a, floatx80 b, float_status *status)
  * Multiplication
  */
 
-float16 QEMU_FLATTEN float16_mul(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_mul(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2125,6 +2226,12 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+float16 QEMU_FLATTEN
+float16_mul(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_mul, soft_f16_mul, f16_is_zon2);
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
@@ -2416,11 +2523,531 @@ float128 QEMU_FLATTEN float128_muladd(float128 a, float128 b, float128 c,
     return float128_round_pack_canonical(pr, status);
 }
 
+/*
+ * Batch operations
+ *
+ * Vector helpers apply one operation to many elements.  These functions
+ * compute chunks of FLOAT_BATCH elements on the host, with the checks of
+ * the scalar hardfloat paths above done on the whole chunk without
+ * branches, so that the loops can be vectorized.  A chunk is kept only
+ * if all of its elements pass; other chunks go element by element
+ * through the scalar functions.  As the elements are independent and the
+ * flags sticky, the results and flags are those of the scalar loop.
+ */
+
+#define FLOAT_BATCH 16
+#define FLOAT_SUM_LANES 8
+
+typedef enum {
+    FLOAT_BATCH_ADD,
+    FLOAT_BATCH_SUB,
+    FLOAT_BATCH_MUL,
+    FLOAT_BATCH_MULADD,
+} FloatBatchOp;
+
+static inline bool float_batch_can_use_fpu(FloatBatchOp op, int flags,
+                                           const float_status *s)
+{
+    if (op == FLOAT_BATCH_MULADD &&
+        (force_soft_fma || (flags & float_muladd_halve_result))) {
+        return false;
+    }
+    return can_use_fpu(s);
+}
+
+/*
+ * The chunks are computed on arrays of the host type with a constant
+ * number of elements, which the compiler vectorizes at -O2.  The checks
+ * are integer operations on the bits: the host may have no vector
+ * compare of doubles whose result it can reduce, e.g. x86-64 before
+ * SSE4.2.  Each check returns 1 when the value needs softfloat.
+ */
+static inline uint32_t f32_batch_bits(float a)
+{
+    uint32_t r;
+
+    memcpy(&r, &a, sizeof(r));
+    return r;
+}
+
+static inline uint32_t f32_batch_nonzero(uint32_t a)
+{
+    a <<= 1;
+    return (a | -a) >> 31;
+}
+
+/* Infinity or NaN */
+static inline uint32_t f32_batch_inf_nan(uint32_t a)
+{
+    return (((a >> 23) & 0xff) + 1) >> 8;
+}
+
+/* Magnitude at most FLT_MIN, where underflow may be raised */
+static inline uint32_t f32_batch_tiny(uint32_t a)
+{
+    return ((a & INT32_MAX) - 0x00800001) >> 31;
+}
+
+/* Anything but a zero or a normal */
+static inline uint32_t f32_batch_special(uint32_t a)
+{
+    return f32_batch_inf_nan(a) | (f32_batch_tiny(a) & f32_batch_nonzero(a));
+}
+
+static inline bool
+f32_batch_chunk(float *r, const float *a, const float *b, bool b_scalar,
+                const float *c, int flags, FloatBatchOp op)
+{
+    uint32_t bad = 0;
+    size_t i;
+
+    for (i = 0; i < FLOAT_BATCH; i++) {
+        float ha = a[i];
+        float hb = b[b_scalar ? 0 : i];
+        float hc = op == FLOAT_BATCH_MULADD ? c[i] : 0;
+        float hr;
+        uint32_t xa, xb, xr;
+
+        xa = f32_batch_bits(ha);
+        xb = f32_batch_bits(hb);
+        bad |= f32_batch_special(xa) | f32_batch_special(xb) |
+               f32_batch_special(f32_batch_bits(hc));
+
+        switch (op) {
+        case FLOAT_BATCH_ADD:
+            hr = ha + hb;
+            break;
+        case FLOAT_BATCH_SUB:
+            hr = ha - hb;
+            break;
+        case FLOAT_BATCH_MUL:
+            hr = ha * hb;
+            break;
+        case FLOAT_BATCH_MULADD:
+            if (flags & float_muladd_negate_product) {
+                ha = -ha;
+            }
+            if (flags & float_muladd_negate_c) {
+                hc = -hc;
+            }
+            hr = fmaf(ha, hb, hc);
+            if (flags & float_muladd_negate_result) {
+                hr = -hr;
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+
+        /*
+         * Overflows go to softfloat, and so do tiny results, except the
+         * zeros of a sum, and anything with a zero product, all exact.
+         */
+        xr = f32_batch_bits(hr);
+        bad |= f32_batch_inf_nan(xr);
+        if (op == FLOAT_BATCH_ADD || op == FLOAT_BATCH_SUB) {
+            bad |= f32_batch_tiny(xr) & f32_batch_nonzero(xr);
+        } else {
+            bad |= f32_batch_tiny(xr) & f32_batch_nonzero(xa) &
+                   f32_batch_nonzero(xb);
+        }
+        r[i] = hr;
+    }
+    return !bad;
+}
+
+static inline bool
+f32_batch_hard(float *r, const float32 *a, const float32 *b,
+               bool b_scalar, const float32 *c, int flags, size_t n,
+               FloatBatchOp op)
+{
+    float pa[FLOAT_BATCH], pb[FLOAT_BATCH], pc[FLOAT_BATCH];
+    const float *ha = (const float *)a;
+    const float *hb = (const float *)b;
+    const float *hc = (const float *)c;
+
+    /* Pad a partial chunk with zeros, which pass every check. */
+    if (n < FLOAT_BATCH) {
+        memset(pa, 0, sizeof(pa));
+        memcpy(pa, a, n * sizeof(float));
+        ha = pa;
+        if (!b_scalar) {
+            memset(pb, 0, sizeof(pb));
+            memcpy(pb, b, n * sizeof(float));
+            hb = pb;
+        }
+        if (op == FLOAT_BATCH_MULADD) {
+            memset(pc, 0, sizeof(pc));
+            memcpy(pc, c, n * sizeof(float));
+            hc = pc;
+        }
+    }
+    /* with a constant b_scalar, each of these loops vectorizes */
+    if (b_scalar) {
+        return f32_batch_chunk(r, ha, hb, true, hc, flags, op);
+    }
+    return f32_batch_chunk(r, ha, hb, false, hc, flags, op);
+}
+
+static inline uint64_t f64_batch_bits(double a)
+{
+    uint64_t r;
+
+    memcpy(&r, &a, sizeof(r));
+    return r;
+}
+
+static inline uint64_t f64_batch_nonzero(uint64_t a)
+{
+    a <<= 1;
+    return (a | -a) >> 63;
+}
+
+static inline uint64_t f64_batch_inf_nan(uint64_t a)
+{
+    return (((a >> 52) & 0x7ff) + 1) >> 11;
+}
+
+static inline uint64_t f64_batch_tiny(uint64_t a)
+{
+    return ((a & INT64_MAX) - 0x0010000000000001ull) >> 63;
+}
+
+static inline uint64_t f64_batch_special(uint64_t a)
+{
+    return f64_batch_inf_nan(a) | (f64_batch_tiny(a) & f64_batch_nonzero(a));
+}
+
+static inline bool
+f64_batch_chunk(double *r, const double *a, const double *b, bool b_scalar,
+                const double *c, int flags, FloatBatchOp op)
+{
+    uint64_t bad = 0;
+    size_t i;
+
+    for (i = 0; i < FLOAT_BATCH; i++) {
+        double ha = a[i];
+        double hb = b[b_scalar ? 0 : i];
+        double hc = op == FLOAT_BATCH_MULADD ? c[i] : 0;
+        double hr;
+        uint64_t xa, xb, xr;
+
+        xa = f64_batch_bits(ha);
+        xb = f64_batch_bits(hb);
+        bad |= f64_batch_special(xa) | f64_batch_special(xb) |
+               f64_batch_special(f64_batch_bits(hc));
+
+        switch (op) {
+        case FLOAT_BATCH_ADD:
+            hr = ha + hb;
+            break;
+        case FLOAT_BATCH_SUB:
+            hr = ha - hb;
+            break;
+        case FLOAT_BATCH_MUL:
+            hr = ha * hb;
+            break;
+        case FLOAT_BATCH_MULADD:
+            if (flags & float_muladd_negate_product) {
+                ha = -ha;
+            }
+            if (flags & float_muladd_negate_c) {
+                hc = -hc;
+            }
+            hr = fma(ha, hb, hc);
+            if (flags & float_muladd_negate_result) {
+                hr = -hr;
+            }
+            break;
+        default:
+            g_assert_not_reached();
+        }
+
+        xr = f64_batch_bits(hr);
+        bad |= f64_batch_inf_nan(xr);
+        if (op == FLOAT_BATCH_ADD || op == FLOAT_BATCH_SUB) {
+            bad |= f64_batch_tiny(xr) & f64_batch_nonzero(xr);
+        } else {
+            bad |= f64_batch_tiny(xr) & f64_batch_nonzero(xa) &
+                   f64_batch_nonzero(xb);
+        }
+        r[i] = hr;
+    }
+    return !bad;
+}
+
+static inline bool
+f64_batch_hard(double *r, const float64 *a, const float64 *b,
+               bool b_scalar, const float64 *c, int flags, size_t n,
+               FloatBatchOp op)
+{
+    double pa[FLOAT_BATCH], pb[FLOAT_BATCH], pc[FLOAT_BATCH];
+    const double *ha = (const double *)a;
+    const double *hb = (const double *)b;
+    const double *hc = (const double *)c;
+
+    if (n < FLOAT_BATCH) {
+        memset(pa, 0, sizeof(pa));
+        memcpy(pa, a, n * sizeof(double));
+        ha = pa;
+        if (!b_scalar) {
+            memset(pb, 0, sizeof(pb));
+            memcpy(pb, b, n * sizeof(double));
+            hb = pb;
+        }
+        if (op == FLOAT_BATCH_MULADD) {
+            memset(pc, 0, sizeof(pc));
+            memcpy(pc, c, n * sizeof(double));
+            hc = pc;
+        }
+    }
+    if (b_scalar) {
+        return f64_batch_chunk(r, ha, hb, true, hc, flags, op);
+    }
+    return f64_batch_chunk(r, ha, hb, false, hc, flags, op);
+}
+
+static inline void
+f32_batch(float32 *d, const float32 *a, const float32 *b, bool b_scalar,
+          const float32 *c, int flags, size_t n, float_status *s,
+          FloatBatchOp op)
+{
+    float r[FLOAT_BATCH];
+    size_t i, j, len;
+
+    for (i = 0; i < n; i += len) {
+        const float32 *bi = b_scalar ? b : b + i;
+
+        len = MIN(n - i, FLOAT_BATCH);
+        if (float_batch_can_use_fpu(op, flags, s) &&
+            f32_batch_hard(r, a + i, bi, b_scalar, c + i, flags, len, op)) {
+            memcpy(d + i, r, len * sizeof(float32));
+            continue;
+        }
+        for (j = 0; j < len; j++) {
+            float32 bj = bi[b_scalar ? 0 : j];
+
+            switch (op) {
+            case FLOAT_BATCH_ADD:
+                d[i + j] = float32_add(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_SUB:
+                d[i + j] = float32_sub(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_MUL:
+                d[i + j] = float32_mul(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_MULADD:
+                d[i + j] = float32_muladd(a[i + j], bj, c[i + j], flags, s);
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+    }
+}
+
+static inline void
+f64_batch(float64 *d, const float64 *a, const float64 *b, bool b_scalar,
+          const float64 *c, int flags, size_t n, float_status *s,
+          FloatBatchOp op)
+{
+    double r[FLOAT_BATCH];
+    size_t i, j, len;
+
+    for (i = 0; i < n; i += len) {
+        const float64 *bi = b_scalar ? b : b + i;
+
+        len = MIN(n - i, FLOAT_BATCH);
+        if (float_batch_can_use_fpu(op, flags, s) &&
+            f64_batch_hard(r, a + i, bi, b_scalar, c + i, flags, len, op)) {
+            memcpy(d + i, r, len * sizeof(float64));
+            continue;
+        }
+        for (j = 0; j < len; j++) {
+            float64 bj = bi[b_scalar ? 0 : j];
+
+            switch (op) {
+            case FLOAT_BATCH_ADD:
+                d[i + j] = float64_add(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_SUB:
+                d[i + j] = float64_sub(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_MUL:
+                d[i + j] = float64_mul(a[i + j], bj, s);
+                break;
+            case FLOAT_BATCH_MULADD:
+                d[i + j] = float64_muladd(a[i + j], bj, c[i + j], flags, s);
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+    }
+}
+
+/* The operations without an addend pass @a as @c, and never read it. */
+
+void QEMU_FLATTEN
+float32_add_n(float32 *d, const float32 *a, const float32 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f32_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_ADD);
+}
+
+void QEMU_FLATTEN
+float32_sub_n(float32 *d, const float32 *a, const float32 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f32_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_SUB);
+}
+
+void QEMU_FLATTEN
+float32_mul_n(float32 *d, const float32 *a, const float32 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f32_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_MUL);
+}
+
+void QEMU_FLATTEN
+float32_muladd_n(float32 *d, const float32 *a, const float32 *b,
+                 bool b_scalar, const float32 *c, int flags, size_t n,
+                 float_status *s)
+{
+    f32_batch(d, a, b, b_scalar, c, flags, n, s, FLOAT_BATCH_MULADD);
+}
+
+void QEMU_FLATTEN
+float64_add_n(float64 *d, const float64 *a, const float64 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f64_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_ADD);
+}
+
+void QEMU_FLATTEN
+float64_sub_n(float64 *d, const float64 *a, const float64 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f64_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_SUB);
+}
+
+void QEMU_FLATTEN
+float64_mul_n(float64 *d, const float64 *a, const float64 *b,
+              bool b_scalar, size_t n, float_status *s)
+{
+    f64_batch(d, a, b, b_scalar, a, 0, n, s, FLOAT_BATCH_MUL);
+}
+
+void QEMU_FLATTEN
+float64_muladd_n(float64 *d, const float64 *a, const float64 *b,
+                 bool b_scalar, const float64 *c, int flags, size_t n,
+                 float_status *s)
+{
+    f64_batch(d, a, b, b_scalar, c, flags, n, s, FLOAT_BATCH_MULADD);
+}
+
+/*
+ * Unordered sums add the elements in FLOAT_SUM_LANES interleaved partial
+ * sums, which start at -0, the identity of addition.  If the result is
+ * finite, no partial sum overflowed, and the tiny ones were exact; with
+ * flush_to_zero, they would not be, so that goes to softfloat.  Anything
+ * else is summed in order by the scalar function.
+ */
+float32 float32_sum_n(float32 acc, const float32 *a, size_t n,
+                      float_status *s)
+{
+    size_t i, j;
+
+    if (can_use_fpu(s) && !s->flush_to_zero &&
+        float32_is_zero_or_normal(acc)) {
+        float part[FLOAT_SUM_LANES];
+        union_float32 ua, ur;
+        bool ok = true;
+
+        for (j = 0; j < FLOAT_SUM_LANES; j++) {
+            part[j] = -0.0f;
+        }
+        for (i = 0; i + FLOAT_SUM_LANES <= n; i += FLOAT_SUM_LANES) {
+            for (j = 0; j < FLOAT_SUM_LANES; j++) {
+                ua.s = a[i + j];
+                ok &= float32_is_zero_or_normal(ua.s);
+                part[j] += ua.h;
+            }
+        }
+        for (j = 0; i < n; i++, j++) {
+            ua.s = a[i];
+            ok &= float32_is_zero_or_normal(ua.s);
+            part[j] += ua.h;
+        }
+        for (j = FLOAT_SUM_LANES / 2; j > 0; j /= 2) {
+            for (i = 0; i < j; i++) {
+                part[i] += part[i + j];
+            }
+        }
+        ua.s = acc;
+        ur.h = ua.h + part[0];
+        if (likely(ok && fabsf(ur.h) <= FLT_MAX)) {
+            return ur.s;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        acc = float32_add(acc, a[i], s);
+    }
+    return acc;
+}
+
+float64 float64_sum_n(float64 acc, const float64 *a, size_t n,
+                      float_status *s)
+{
+    size_t i, j;
+
+    if (can_use_fpu(s) && !s->flush_to_zero &&
+        float64_is_zero_or_normal(acc)) {
+        double part[FLOAT_SUM_LANES];
+        union_float64 ua, ur;
+        bool ok = true;
+
+        for (j = 0; j < FLOAT_SUM_LANES; j++) {
+            part[j] = -0.0;
+        }
+        for (i = 0; i + FLOAT_SUM_LANES <= n; i += FLOAT_SUM_LANES) {
+            for (j = 0; j < FLOAT_SUM_LANES; j++) {
+                ua.s = a[i + j];
+                ok &= float64_is_zero_or_normal(ua.s);
+                part[j] += ua.h;
+            }
+        }
+        for (j = 0; i < n; i++, j++) {
+            ua.s = a[i];
+            ok &= float64_is_zero_or_normal(ua.s);
+            part[j] += ua.h;
+        }
+        for (j = FLOAT_SUM_LANES / 2; j > 0; j /= 2) {
+            for (i = 0; i < j; i++) {
+                part[i] += part[i + j];
+            }
+        }
+        ua.s = acc;
+        ur.h = ua.h + part[0];
+        if (likely(ok && fabs(ur.h) <= DBL_MAX)) {
+            return ur.s;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        acc = float64_add(acc, a[i], s);
+    }
+    return acc;
+}
+
 /*
  * Division
  */
 
-float16 float16_div(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_div(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2483,6 +3110,11 @@ static bool f64_div_pre(union_float64 a, union_float64 b)
     return float64_is_zero_or_normal(a.s) && float64_is_normal(b.s);
 }
 
+static bool f16_div_pre(float16 a, float16 b)
+{
+    return f16_is_zon(a) && float16_is_normal(b);
+}
+
 static bool f32_div_post(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -2499,6 +3131,12 @@ static bool f64_div_post(union_float64 a, union_float64 b)
     return !float64_is_zero(a.s);
 }
 
+float16 QEMU_FLATTEN
+float16_div(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_div, soft_f16_div, f16_div_pre);
+}
+
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
@@ -3023,6 +3661,55 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
  * Floating-point to signed integer conversions
  */
 
+/*
+ * The host rounds to an integral value exactly, so conversions to
+ * integer only need to check that the result is in range: unlike the
+ * arithmetic above, they use the host in any of the usual rounding
+ * modes, whether or not the inexact flag is already set.  The range is
+ * [@lo, @hi), with bounds that are powers of two and thus exact.
+ */
+static inline bool hard_float_to_int(double a, FloatRoundMode rmode,
+                                     double lo, double hi, double *pr,
+                                     float_status *s)
+{
+    double r;
+
+    if (QEMU_NO_HARDFLOAT || s->flush_inputs_to_zero) {
+        return false;
+    }
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        /* as everywhere else, the host rounding mode is left at RNE */
+        r = rint(a);
+        break;
+    case float_round_ties_away:
+        r = round(a);
+        break;
+    case float_round_down:
+        r = floor(a);
+        break;
+    case float_round_up:
+        r = ceil(a);
+        break;
+    case float_round_to_zero:
+        r = trunc(a);
+        break;
+    default:
+        return false;
+    }
+
+    /* This also sends NaNs to softfloat. */
+    if (unlikely(!(r >= lo && r < hi))) {
+        return false;
+    }
+    if (r != a) {
+        float_raise(float_flag_inexact, s);
+    }
+    *pr = r;
+    return true;
+}
+
 int8_t float16_to_int8_scalbn(float16 a, FloatRoundMode rmode, int scale,
                               float_status *s)
 {
@@ -3072,6 +3759,14 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, -0x1p31, 0x1p31, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3081,6 +3776,14 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, -0x1p63, 0x1p63, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3099,6 +3802,14 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, -0x1p31, 0x1p31, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3108,6 +3819,14 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, -0x1p63, 0x1p63, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3462,6 +4181,14 @@ uint32_t float32_to_uint32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, 0, 0x1p32, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3471,6 +4198,14 @@ uint64_t float32_to_uint64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, 0, 0x1p64, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -3489,6 +4224,14 @@ uint32_t float64_to_uint32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, 0, 0x1p32, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3498,6 +4241,14 @@ uint64_t float64_to_uint64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(scale == 0) &&
+        hard_float_to_int(ua.h, rmode, 0, 0x1p64, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -3805,7 +4556,8 @@ float32 int64_to_float32_scalbn(int64_t a, int scale, float_status *status)
     FloatParts64 p;
 
     /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    if (likely(scale == 0) &&
+        (can_use_fpu(status) || hard_sint_is_exact(a, 24))) {
         union_float32 ur;
         ur.h = a;
         return ur.s;
@@ -3845,7 +4597,8 @@ float64 int64_to_float64_scalbn(int64_t a, int scale, float_status *status)
     FloatParts64 p;
 
     /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    if (likely(scale == 0) &&
+        (can_use_fpu(status) || hard_sint_is_exact(a, 53))) {
         union_float64 ur;
         ur.h = a;
         return ur.s;
@@ -4015,7 +4768,8 @@ float32 uint64_to_float32_scalbn(uint64_t a, int scale, float_status *status)
     FloatParts64 p;
 
     /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    if (likely(scale == 0) &&
+        (can_use_fpu(status) || hard_uint_is_exact(a, 24))) {
         union_float32 ur;
         ur.h = a;
         return ur.s;
@@ -4055,7 +4809,8 @@ float64 uint64_to_float64_scalbn(uint64_t a, int scale, float_status *status)
     FloatParts64 p;
 
     /* Without scaling, there are no overflow concerns. */
-    if (likely(scale == 0) && can_use_fpu(status)) {
+    if (likely(scale == 0) &&
+        (can_use_fpu(status) || hard_uint_is_exact(a, 53))) {
         union_float64 ur;
         ur.h = a;
         return ur.s;
@@ -4493,6 +5248,12 @@ floatx80 floatx80_scalbn(floatx80 a, int n, float_status *status)
 float16 QEMU_FLATTEN float16_sqrt(float16 a, float_status *status)
 {
     FloatParts64 p;
+    float16 r;
+
+    if (can_use_fpu(status) && f16_is_zon(a) && !float16_is_neg(a) &&
+        likely(f16_from_host(sqrtf(f16_to_host(a)), &r))) {
+        return r;
+    }
 
     float16_unpack_canonical(&p, a, status);
     parts_sqrt(&p, status, &float16_params);
@@ -283,6 +283,25 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "max:i?,sort:s?",
+        .params     = "[max] [sort]",
+        .help       = "show the max (default: 10) hottest translation "
+                      "blocks, sorted by executions, guest-insns, spills, "
+                      "translations or translate-time",
+    },
+#endif
+
+SRST
+  ``info tb-stats`` [*max*] [*sort*]
+    Show the *max* (default: 10) hottest translation blocks, as collected
+    with ``-accel tcg,tb-stats=on``.  *sort* is one of ``executions``
+    (the default), ``guest-insns``, ``spills``, ``translations`` or
+    ``translate-time``.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -82,6 +82,9 @@ typedef uint64_t target_ulong;
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
 
+/* track up to 8 regions of large pages per mmu_idx */
+#define CPU_TLB_LARGE_PAGES 8
+
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
 #else
@@ -181,15 +184,23 @@ typedef struct CPUTLBEntryFull {
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
+/*
+ * A region covering some of the large pages allocated into the tlb.
+ * An address A is within the region if (A & mask) == addr.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe regions covering all of the large pages allocated
+     * into the tlb.  When any page within a region is flushed,
+     * we must flush every entry within that region.
      */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
+    unsigned n_large_pages;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -226,6 +237,13 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * TLBs saved by tlb_switch_context, or NULL if it was never called.
+     * Protected by tlb_c.lock.
+     */
+    struct CPUTLBSaved *saved;
+    /* Flushes asked by other cpus, pending on this one. */
+    struct CPUTLBFlushQueue *flush_queue;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -234,6 +252,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t large_flush_count;
+    size_t coalesced_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -155,6 +155,33 @@ void tlb_flush_all_cpus(CPUState *src_cpu);
  * the guests translation ends the TB.
  */
 void tlb_flush_all_cpus_synced(CPUState *src_cpu);
+/**
+ * tlb_switch_context:
+ * @cpu: CPU whose TLB should be switched
+ * @old_tag: tag of the translation context being left
+ * @new_tag: tag of the translation context being entered
+ *
+ * Save the TLB of the specified CPU under @old_tag, and replace it with
+ * the TLB last saved under @new_tag, or with an empty TLB.  This is a
+ * flush for architectures that tag TLB entries with an address space
+ * identifier, where switching back to a recent address space may reuse
+ * its translations.  Every other flush also applies to the saved TLBs.
+ * Must be called on @cpu itself.
+ */
+void tlb_switch_context(CPUState *cpu, uint64_t old_tag, uint64_t new_tag);
+/**
+ * tlb_flush_context:
+ * @cpu: CPU whose TLB should be flushed
+ * @cur_tag: tag of the current translation context
+ * @tag: tag of the translation contexts to flush
+ * @mask: bits of the tags to compare
+ *
+ * Flush the translation contexts of the specified CPU whose tag is @tag
+ * under @mask, including the current one if @cur_tag matches.
+ * Must be called on @cpu itself.
+ */
+void tlb_flush_context(CPUState *cpu, uint64_t cur_tag,
+                       uint64_t tag, uint64_t mask);
 /**
  * tlb_flush_page_by_mmuidx:
  * @cpu: CPU whose TLB should be flushed
@@ -348,6 +375,14 @@ static inline void tlb_flush_all_cpus(CPUState *src_cpu)
 static inline void tlb_flush_all_cpus_synced(CPUState *src_cpu)
 {
 }
+static inline void tlb_switch_context(CPUState *cpu, uint64_t old_tag,
+                                      uint64_t new_tag)
+{
+}
+static inline void tlb_flush_context(CPUState *cpu, uint64_t cur_tag,
+                                     uint64_t tag, uint64_t mask)
+{
+}
 static inline void tlb_flush_page_by_mmuidx(CPUState *cpu,
                                             target_ulong addr, uint16_t idxmap)
 {
@@ -611,6 +646,20 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Executions left before a cold TB, translated without optimization,
+     * is retranslated with the full optimizer.  Zero or negative for a
+     * hot TB.  Cold TBs are never chained to, so that every execution
+     * goes through the main loop and is counted there.
+     */
+    int32_t tier_count;
+
+    /* Translated ahead of execution, and not yet looked up since. */
+    bool prefetched;
+
+    /* Execution statistics, if -accel tcg,tb-stats=on */
+    struct TBStatistics *tb_stats;
 };
 
 /* Hide the read to avoid ifdefs for TARGET_TB_PCREL. */
@@ -629,6 +678,11 @@ static inline uint32_t tb_cflags(const TranslationBlock *tb)
     return qatomic_read(&tb->cflags);
 }
 
+static inline bool tb_is_cold(const TranslationBlock *tb)
+{
+    return qatomic_read(&tb->tier_count) > 0;
+}
+
 static inline tb_page_addr_t tb_page_addr0(const TranslationBlock *tb)
 {
 #ifdef CONFIG_USER_ONLY
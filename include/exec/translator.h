@@ -77,6 +77,8 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @num_jumps_followed: Number of jumps translated inline, see
+ *                      translator_follow_jump().
  *
  * Architecture-agnostic disassembly context.
  */
@@ -88,6 +90,7 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    int num_jumps_followed;
     void *host_addr[2];
 } DisasContextBase;
 
@@ -162,6 +165,48 @@ void translator_loop_temp_check(DisasContextBase *db);
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation may continue at @dest, making the current
+ * TB a superblock that contains both the jump and its target.  If so,
+ * the jump must not emit any code other than its side effects, and the
+ * next instruction translated must be the one at @dest.
+ */
+bool translator_follow_jump(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_lookup_and_goto_ptr
+ * @db: Disassembly context
+ * @dest: target pc of the indirect branch at @db->pc_next, already
+ *        stored as the pc of the cpu
+ * @is_return: true if the branch is a return from a function
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), but if enabled with -accel tcg,ibtc
+ * or -accel tcg,ras, first check inline for a TB predicted for @dest by
+ * the indirect branch target cache entry of this branch or, for a
+ * return, by the return address stack.
+ *
+ * A predicted TB is used only if its cs_base, flags and cflags are those
+ * of the current TB: the cpu state that they summarize must not have
+ * been changed by the current TB, other than in ways that the target
+ * knows are harmless.
+ */
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv dest,
+                                    bool is_return);
+
+/**
+ * translator_push_return
+ * @db: Disassembly context
+ * @ret: return address of a function call
+ *
+ * Push @ret onto the return address stack, for a later return with
+ * translator_lookup_and_goto_ptr().
+ */
+void translator_push_return(DisasContextBase *db, target_ulong ret);
+
 /*
  * Translator Load Functions
  *
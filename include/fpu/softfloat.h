@@ -585,6 +585,26 @@ float32 float32_mul(float32, float32, float_status *status);
 float32 float32_div(float32, float32, float_status *status);
 float32 float32_rem(float32, float32, float_status *status);
 float32 float32_muladd(float32, float32, float32, int, float_status *status);
+
+/*
+ * Batch operations, with the results and flags of the scalar functions
+ * applied to each of the @n elements in turn: d[i] = a[i] op b[i], with
+ * b[0] instead of b[i] if @b_scalar, and c[i] as the addend of muladd.
+ * @d may be any of the other arrays, but not a scalar @b.  The sum adds
+ * the elements to @acc in an unspecified order.
+ */
+void float32_add_n(float32 *d, const float32 *a, const float32 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float32_sub_n(float32 *d, const float32 *a, const float32 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float32_mul_n(float32 *d, const float32 *a, const float32 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float32_muladd_n(float32 *d, const float32 *a, const float32 *b,
+                      bool b_scalar, const float32 *c, int flags, size_t n,
+                      float_status *status);
+float32 float32_sum_n(float32 acc, const float32 *a, size_t n,
+                      float_status *status);
+
 float32 float32_sqrt(float32, float_status *status);
 float32 float32_exp2(float32, float_status *status);
 float32 float32_log2(float32, float_status *status);
@@ -777,6 +797,26 @@ float64 float64_mul(float64, float64, float_status *status);
 float64 float64_div(float64, float64, float_status *status);
 float64 float64_rem(float64, float64, float_status *status);
 float64 float64_muladd(float64, float64, float64, int, float_status *status);
+
+/*
+ * Batch operations, with the results and flags of the scalar functions
+ * applied to each of the @n elements in turn: d[i] = a[i] op b[i], with
+ * b[0] instead of b[i] if @b_scalar, and c[i] as the addend of muladd.
+ * @d may be any of the other arrays, but not a scalar @b.  The sum adds
+ * the elements to @acc in an unspecified order.
+ */
+void float64_add_n(float64 *d, const float64 *a, const float64 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float64_sub_n(float64 *d, const float64 *a, const float64 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float64_mul_n(float64 *d, const float64 *a, const float64 *b,
+                   bool b_scalar, size_t n, float_status *status);
+void float64_muladd_n(float64 *d, const float64 *a, const float64 *b,
+                      bool b_scalar, const float64 *c, int flags, size_t n,
+                      float_status *status);
+float64 float64_sum_n(float64 acc, const float64 *a, size_t n,
+                      float_status *status);
+
 float64 float64_sqrt(float64, float_status *status);
 float64 float64_log2(float64, float_status *status);
 FloatRelation float64_compare(float64, float64, float_status *status);
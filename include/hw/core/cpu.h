@@ -287,6 +287,10 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @icount_quantum_done: Instructions executed in the current parallel
+ * icount quantum.
+ * @icount_quantum_state: Whether the CPU owes instructions to, has
+ * completed, or sits out the current parallel icount quantum.
  * @can_do_io: Nonzero if memory-mapped IO is safe. Deterministic execution
  * requires that IO only be performed on the last instruction of a TB
  * so that interrupts take effect immediately.
@@ -356,6 +360,8 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t icount_quantum_done;
+    int icount_quantum_state;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
@@ -0,0 +1,57 @@
+/*
+ * Element permutations for vector instruction helpers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_VPERM_H
+#define QEMU_VPERM_H
+
+/*
+ * The functions below work on arrays of host-endian elements of @esz
+ * bytes, where @esz is 1, 2, 4 or 8.  The source and the destination
+ * must not overlap, and need not be aligned.
+ */
+
+/*
+ * vperm_deinterleave:
+ * Split the @n segments of @nf elements at @src into @nf arrays of @n
+ * elements, the k-th of which starts at @dst + k * @stride.
+ */
+void vperm_deinterleave(void *dst, size_t stride, const void *src,
+                        unsigned nf, unsigned esz, size_t n);
+
+/*
+ * vperm_interleave:
+ * The inverse of vperm_deinterleave: store to @dst the @n segments made
+ * of the elements of the @nf arrays at @src + k * @stride.
+ */
+void vperm_interleave(void *dst, const void *src, size_t stride,
+                      unsigned nf, unsigned esz, size_t n);
+
+/*
+ * vperm_gather:
+ * Set each of the @n elements of @dst to the element of @src selected
+ * by the unsigned element of @idx at the same position, or to 0 if that
+ * index is @limit or more.  @idx has elements of @esz bytes too.
+ */
+void vperm_gather(void *dst, const void *src, const void *idx,
+                  unsigned esz, size_t n, uint64_t limit);
+
+/*
+ * vperm_compress:
+ * Copy the elements among the first @n of @src whose bit is set in
+ * @mask, bit i % 64 of mask[i / 64] for element i, to the start of
+ * @dst.  The elements of @dst past the copied ones are left untouched.
+ * Return the number of elements copied.
+ */
+size_t vperm_compress(void *dst, const void *src, const uint64_t *mask,
+                      unsigned esz, size_t n);
+
+/*
+ * Select the next accelerated implementation, for testing.  Return
+ * false when the portable implementation is in use.
+ */
+bool test_vperm_next_accel(void);
+
+#endif /* QEMU_VPERM_H */
@@ -31,6 +31,18 @@ extern int use_icount;
 #define icount_enabled() 0
 #endif
 
+/*
+ * Parallel icount: with a non-zero quantum every vCPU runs in its own
+ * thread and the vCPUs advance QEMU_CLOCK_VIRTUAL in lockstep, one
+ * quantum of instructions at a time.
+ */
+#ifdef CONFIG_TCG
+extern int64_t icount_quantum;
+#define icount_parallel() (icount_quantum != 0)
+#else
+#define icount_parallel() 0
+#endif
+
 /*
  * Update the icount with the executed instructions. Called by
  * cpus-tcg vCPU thread so the main-loop can see time has moved forward.
@@ -56,6 +68,9 @@ void icount_configure(QemuOpts *opts, Error **errp);
 /* used by tcg vcpu thread to calc icount budget */
 int64_t icount_round(int64_t count);
 
+/* move QEMU_CLOCK_VIRTUAL forward at the end of a parallel quantum */
+void icount_advance(int64_t count);
+
 /* if the CPUs are idle, start accounting real time to virtual clock. */
 void icount_start_warp_timer(void);
 void icount_account_warp_timer(void);
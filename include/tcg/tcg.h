@@ -244,6 +244,10 @@ struct TCGLabel {
     unsigned has_value : 1;
     unsigned id : 14;
     unsigned refs : 16;
+    /* Forward conditional branches seen by the register allocator. */
+    unsigned nb_edges : 16;
+    /* Globals held in each host register by all of those branches. */
+    TCGTemp **edge_regs;
     union {
         uintptr_t value;
         const tcg_insn_unit *value_ptr;
@@ -557,6 +561,9 @@ struct TCGContext {
     TCGTemp *frame_temp;
 
     TranslationBlock *gen_tb;     /* tb for which code is being generated */
+    bool gen_speculative;         /* gen_tb may be abandoned, see translator */
+    bool regalloc_tb;             /* keep globals in regs across labels */
+    unsigned spill_count;         /* registers spilled for gen_tb */
     tcg_insn_unit *code_buf;      /* pointer for start of tb */
     tcg_insn_unit *code_ptr;      /* pointer for running end of tb */
 
@@ -623,6 +630,10 @@ struct TCGContext {
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
+    /* Destinations of the goto_tb emitted for gen_tb. */
+    int gen_nb_succ;
+    target_ulong gen_succ[2];
+
     /* Exit to translator on overflow. */
     sigjmp_buf jmp_trans;
 };
@@ -636,6 +647,8 @@ extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
 extern TCGv_env cpu_env;
+/* Keep globals in host registers across forward branches within a TB */
+extern bool tcg_regalloc_tb;
 
 bool in_code_gen_buffer(const void *p);
 
@@ -810,6 +823,9 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+void tcg_region_touch(const void *tc_ptr);
+bool tcg_region_has_free(void);
+bool tcg_region_evict(GTraverseFunc evict_tb);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
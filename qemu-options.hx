@@ -184,6 +184,13 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-profile=file (record and replay TCG translations)\n"
+    "                tier-threshold=n (optimize translation blocks after n executions)\n"
+    "                tb-prefetch=on|off (translate direct successors ahead of execution)\n"
+    "                ibtc=on|off (predict indirect branch targets inline)\n"
+    "                ras=on|off (predict function return targets inline)\n"
+    "                regalloc=bb|tb (scope of TCG register allocation, default bb)\n"
+    "                tb-stats=on|off (collect per translation block statistics)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
@@ -219,6 +226,63 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-profile=file``
+        Records which guest code was translated by TCG in ``file`` when
+        QEMU exits.  If ``file`` exists at startup, the first block
+        translated from a guest page whose contents match a recorded
+        page causes all recorded blocks of that page to be translated
+        at once, instead of one at a time as the guest reaches them.
+
+    ``tier-threshold=n``
+        Translates guest code quickly, without running the TCG
+        optimizer, and retranslates a translation block with all
+        optimizations once it has been executed ``n`` times.  Blocks
+        are not chained to one another until they have been
+        retranslated.  Where the target supports it, retranslated
+        blocks also follow unconditional jumps forward within the same
+        guest page, so that a chain of small blocks becomes a single
+        superblock.  The default of 0 optimizes every block when it is
+        first translated.
+
+    ``tb-prefetch=on|off``
+        When a translation block is generated, also translates the
+        targets of its direct jumps that lie in the same guest page,
+        so that the vCPU usually finds them already translated.  The
+        number of blocks translated ahead, and how many of them were
+        executed, is reported by ``info jit``.
+
+    ``ibtc=on|off``
+        Each indirect branch checks inline whether its target is the
+        one it jumped to last, and if so jumps to the translated code
+        directly without looking it up.  Only targets whose front end
+        marks indirect branches benefit.
+
+    ``ras=on|off``
+        Calls push their return address on a per-vCPU stack, and
+        returns check inline whether their target is the one on top of
+        the stack.  Like ``ibtc``, this avoids looking up the target
+        when it was predicted correctly.  ``info jit`` reports how many
+        branches were not predicted by either.
+
+    ``regalloc=bb|tb``
+        Controls how long TCG keeps guest registers in host registers.
+        With ``bb``, the default, they are written back to memory at the
+        end of every basic block.  With ``tb``, they also stay in host
+        registers across a label when every branch to it is a forward
+        conditional branch that leaves them in the same host registers,
+        which avoids reloading them after ``if``-like control flow
+        inside a translation block.
+
+    ``tb-stats=on|off``
+        Keeps statistics for each translation block: how often it was
+        executed, its length in guest instructions and in bytes of host
+        code, the registers spilled by its latest translation, and how
+        often and for how long it was translated.  Counts are kept across
+        retranslations of the same guest code with the same flags and
+        compile flags.  The hottest blocks are
+        listed by ``info tb-stats``; the host address of each block
+        matches the entries written with ``-perfmap`` or ``-jitdump``.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -4433,13 +4497,14 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,quantum=N][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
-    "                or disable real time cpu sleeping, and optionally enable\n" \
+    "                or disable real time cpu sleeping, run the vCPUs in parallel\n" \
+    "                in quanta of N instructions, and optionally enable\n" \
     "                record-and-replay mode\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
+``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,quantum=N][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -4473,6 +4538,18 @@ SRST
     depends on the host machine). The default if icount is enabled
     is ``align=off``.
 
+    By default all vCPUs share a single thread when icount is enabled.
+    ``quantum=N`` instead gives each vCPU its own thread (it requires
+    ``-accel tcg,thread=multi``). The vCPUs run N instructions each,
+    or fewer if a QEMU_CLOCK_VIRTUAL timer is due earlier, and then
+    wait for each other before virtual time moves on. Time reads and
+    timer interrupts therefore happen at the same instruction counts
+    from one run to the next, however the host schedules the threads;
+    timers fire at the first quantum boundary after their deadline.
+    The order of racing memory accesses between vCPUs within a quantum
+    is still decided by the host. ``quantum`` requires a fixed
+    ``shift`` and ``sleep=off``, and cannot be combined with ``rr``.
+
     When the ``rr`` option is specified deterministic record/replay is
     enabled. The ``rrfile=`` option must also be provided to
     specify the path to the replay log. In record mode data is written
@@ -57,6 +57,12 @@ static bool icount_sleep = true;
  */
 int use_icount;
 
+/*
+ * Length in instructions of a parallel icount quantum, or 0 when the
+ * vCPUs share a single round-robin thread.
+ */
+int64_t icount_quantum;
+
 static void icount_enable_precise(void)
 {
     use_icount = 1;
@@ -88,6 +94,11 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_parallel()) {
+        /* the global count only moves at the end of a quantum */
+        cpu->icount_quantum_done += executed;
+        return;
+    }
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -99,6 +110,10 @@ static void icount_update_locked(CPUState *cpu)
  */
 void icount_update(CPUState *cpu)
 {
+    if (icount_parallel()) {
+        icount_update_locked(cpu);
+        return;
+    }
     seqlock_write_lock(&timers_state.vm_clock_seqlock,
                        &timers_state.vm_clock_lock);
     icount_update_locked(cpu);
@@ -118,6 +133,11 @@ static int64_t icount_get_raw_locked(void)
         /* Take into account what has run */
         icount_update_locked(cpu);
     }
+    if (icount_parallel() && cpu) {
+        /* a vCPU sees the quantum start plus its own progress */
+        return qatomic_read_i64(&timers_state.qemu_icount) +
+            cpu->icount_quantum_done;
+    }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
     return qatomic_read_i64(&timers_state.qemu_icount);
 }
@@ -231,6 +251,16 @@ int64_t icount_round(int64_t count)
     return (count + (1 << shift) - 1) >> shift;
 }
 
+void icount_advance(int64_t count)
+{
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount,
+                    timers_state.qemu_icount + count);
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 static void icount_warp_rt(void)
 {
     unsigned seq;
@@ -302,6 +332,11 @@ void icount_start_warp_timer(void)
         return;
     }
 
+    /* The quantum barrier skips idle time itself, in a vCPU thread */
+    if (icount_parallel()) {
+        return;
+    }
+
     if (replay_mode != REPLAY_MODE_PLAY) {
         if (!all_cpu_threads_idle()) {
             return;
@@ -420,11 +455,14 @@ void icount_configure(QemuOpts *opts, Error **errp)
     const char *option = qemu_opt_get(opts, "shift");
     bool sleep = qemu_opt_get_bool(opts, "sleep", true);
     bool align = qemu_opt_get_bool(opts, "align", false);
+    int64_t quantum = qemu_opt_get_number(opts, "quantum", 0);
     long time_shift = -1;
 
     if (!option) {
         if (qemu_opt_get(opts, "align") != NULL) {
             error_setg(errp, "Please specify shift option when using align");
+        } else if (quantum) {
+            error_setg(errp, "Please specify shift option when using quantum");
         }
         return;
     }
@@ -434,6 +472,25 @@ void icount_configure(QemuOpts *opts, Error **errp)
         return;
     }
 
+    if (quantum) {
+        if (quantum < 0) {
+            error_setg(errp, "icount: Invalid quantum value");
+            return;
+        }
+        if (strcmp(option, "auto") == 0) {
+            error_setg(errp, "quantum requires a fixed shift");
+            return;
+        }
+        if (sleep) {
+            error_setg(errp, "quantum requires sleep=off");
+            return;
+        }
+        if (qemu_opt_get(opts, "rr")) {
+            error_setg(errp, "quantum and record/replay are incompatible");
+            return;
+        }
+    }
+
     if (strcmp(option, "auto") != 0) {
         if (qemu_strtol(option, NULL, 0, &time_shift) < 0
             || time_shift < 0 || time_shift > MAX_ICOUNT_SHIFT) {
@@ -458,6 +515,7 @@ void icount_configure(QemuOpts *opts, Error **errp)
 
     if (time_shift >= 0) {
         timers_state.icount_time_shift = time_shift;
+        icount_quantum = quantum;
         icount_enable_precise();
         return;
     }
@@ -5,6 +5,7 @@
 /* icount - Instruction Counter API */
 
 int use_icount;
+int64_t icount_quantum;
 
 void icount_update(CPUState *cpu)
 {
@@ -482,6 +482,11 @@ static void riscv_cpu_dump_state(CPUState *cs, FILE *f, int flags)
             }
         }
     }
+    if (cpu->cfg.pwc) {
+        qemu_fprintf(f, " pwc hits %" PRIu64 " misses %" PRIu64
+                     " flushes %" PRIu64 "\n",
+                     env->pwc_hits, env->pwc_misses, env->pwc_flushes);
+    }
 #endif
 
     for (i = 0; i < 32; i++) {
@@ -612,6 +617,7 @@ static void riscv_cpu_reset_hold(Object *obj)
     env->pc = env->resetvec;
     env->bins = 0;
     env->two_stage_lookup = false;
+    riscv_cpu_pwc_flush(env);
 
     /* Initialized default priorities of local interrupts. */
     for (i = 0; i < ARRAY_SIZE(env->miprio); i++) {
@@ -1146,6 +1152,8 @@ static Property riscv_cpu_extensions[] = {
     DEFINE_PROP_BOOL("x-j", RISCVCPU, cfg.ext_j, false),
     /* ePMP 0.9.3 */
     DEFINE_PROP_BOOL("x-epmp", RISCVCPU, cfg.epmp, false),
+    /* Cache non-leaf page table entries across page table walks */
+    DEFINE_PROP_BOOL("x-pwc", RISCVCPU, cfg.pwc, false),
     DEFINE_PROP_BOOL("x-smaia", RISCVCPU, cfg.ext_smaia, false),
     DEFINE_PROP_BOOL("x-ssaia", RISCVCPU, cfg.ext_ssaia, false),
 
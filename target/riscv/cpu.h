@@ -145,6 +145,21 @@ typedef struct PMUCTRState {
     target_ulong irq_overflow_left;
 } PMUCTRState;
 
+#define RISCV_PWC_ENTRIES 16
+
+/*
+ * A page-walk cache entry: the base of the page table at @level
+ * (counting from the root) that translates the addresses whose
+ * upper bits are @prefix, in the page tables identified by @tag.
+ */
+typedef struct RISCVPWCEntry {
+    uint64_t tag;
+    uint64_t gtag;
+    target_ulong prefix;
+    hwaddr base;
+    int level;
+} RISCVPWCEntry;
+
 struct CPUArchState {
     target_ulong gpr[32];
     target_ulong gprh[32]; /* 64 top bits of the 128-bit registers */
@@ -152,6 +167,13 @@ struct CPUArchState {
 
     /* vector coprocessor state. */
     uint64_t vreg[32 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
+    /*
+     * scratch register groups for inline expansion, not migrated;
+     * each holds a whole group of up to LMUL=8 registers
+     */
+    uint64_t vtmp[8 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
+    uint64_t vsel[8 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
+    uint64_t vones[8 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
     target_ulong vxrm;
     target_ulong vxsat;
     target_ulong vl;
@@ -323,6 +345,13 @@ struct CPUArchState {
     pmp_table_t pmp_state;
     target_ulong mseccfg;
 
+    /* page-walk cache, a level of 0 marks a free entry */
+    RISCVPWCEntry pwc[RISCV_PWC_ENTRIES];
+    unsigned pwc_next;
+    uint64_t pwc_hits;
+    uint64_t pwc_misses;
+    uint64_t pwc_flushes;
+
     /* trigger module */
     target_ulong trigger_cur;
     target_ulong tdata1[RV_MAX_TRIGGERS];
@@ -498,6 +527,7 @@ struct RISCVCPUConfig {
     bool pmp;
     bool epmp;
     bool debug;
+    bool pwc;
 
     bool short_isa_string;
 };
@@ -606,6 +636,8 @@ void riscv_cpu_set_aia_ireg_rmw_fn(CPURISCVState *env, uint32_t priv,
                                                  target_ulong new_val,
                                                  target_ulong write_mask),
                                    void *rmw_fn_arg);
+void riscv_cpu_pwc_flush(CPURISCVState *env);
+void riscv_cpu_pwc_flush_all(CPURISCVState *env);
 #endif
 void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv);
 
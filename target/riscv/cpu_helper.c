@@ -729,6 +729,89 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot,
     return TRANSLATE_SUCCESS;
 }
 
+/*
+ * The page-walk cache remembers the intermediate page tables found by
+ * previous walks, so that a walk can start from the deepest table known
+ * for the address rather than from the root.  Entries are tagged with
+ * the root of the page tables and the translation mode; the guest must
+ * execute sfence.vma or hfence after changing a non-leaf PTE, as for
+ * the TLB, and those flush the cache.
+ */
+void riscv_cpu_pwc_flush(CPURISCVState *env)
+{
+    if (!env_archcpu(env)->cfg.pwc) {
+        return;
+    }
+    trace_riscv_pwc_flush(env->mhartid);
+    memset(env->pwc, 0, sizeof(env->pwc));
+    env->pwc_next = 0;
+    env->pwc_flushes++;
+}
+
+static void riscv_cpu_pwc_flush_work(CPUState *cs, run_on_cpu_data data)
+{
+    riscv_cpu_pwc_flush(&RISCV_CPU(cs)->env);
+}
+
+void riscv_cpu_pwc_flush_all(CPURISCVState *env)
+{
+    CPUState *src = env_cpu(env);
+    CPUState *cs;
+
+    if (!env_archcpu(env)->cfg.pwc) {
+        return;
+    }
+    CPU_FOREACH(cs) {
+        if (cs != src) {
+            async_run_on_cpu(cs, riscv_cpu_pwc_flush_work, RUN_ON_CPU_NULL);
+        }
+    }
+    riscv_cpu_pwc_flush(env);
+}
+
+/*
+ * Return the deepest level of the walk of @addr whose page table is
+ * cached, setting @base to that table, or 0 to walk from the root.
+ */
+static int riscv_pwc_lookup(CPURISCVState *env, uint64_t tag, uint64_t gtag,
+                            target_ulong addr, int levels, int ptidxbits,
+                            hwaddr *base)
+{
+    int level = 0;
+    int i;
+
+    for (i = 0; i < RISCV_PWC_ENTRIES; i++) {
+        RISCVPWCEntry *e = &env->pwc[i];
+
+        if (e->level > level && e->tag == tag && e->gtag == gtag &&
+            e->prefix == addr >> (PGSHIFT + (levels - e->level) * ptidxbits)) {
+            level = e->level;
+            *base = e->base;
+        }
+    }
+
+    if (level) {
+        env->pwc_hits++;
+        trace_riscv_pwc_hit(env->mhartid, addr, level, *base);
+    } else {
+        env->pwc_misses++;
+        trace_riscv_pwc_miss(env->mhartid, addr);
+    }
+    return level;
+}
+
+static void riscv_pwc_insert(CPURISCVState *env, uint64_t tag, uint64_t gtag,
+                             target_ulong prefix, int level, hwaddr base)
+{
+    RISCVPWCEntry *e = &env->pwc[env->pwc_next++ % RISCV_PWC_ENTRIES];
+
+    e->tag = tag;
+    e->gtag = gtag;
+    e->prefix = prefix;
+    e->level = level;
+    e->base = base;
+}
+
 /* get_physical_address - get the physical address for this virtual address
  *
  * Do a page table walk to obtain the physical address corresponding to a
@@ -739,6 +822,8 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot,
  * @env: CPURISCVState
  * @physical: This will be set to the calculated physical address
  * @prot: The returned protection attributes
+ * @page_size: If not NULL, this will be set to the size of the leaf
+ *             page or superpage mapping @addr, if the walk found one
  * @addr: The virtual address to be translated
  * @fault_pte_addr: If not NULL, this will be set to fault pte address
  *                  when a error occurs on pte address translation.
@@ -751,7 +836,8 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot,
  * @is_debug: Is this access from a debugger or the monitor?
  */
 static int get_physical_address(CPURISCVState *env, hwaddr *physical,
-                                int *prot, target_ulong addr,
+                                int *prot, target_ulong *page_size,
+                                target_ulong addr,
                                 target_ulong *fault_pte_addr,
                                 int access_type, int mmu_idx,
                                 bool first_stage, bool two_stage,
@@ -876,13 +962,32 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         return TRANSLATE_FAIL;
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    hwaddr root = base;
+    uint64_t pwc_tag = 0, pwc_gtag = 0;
+    /*
+     * Debug walks come from the gdbstub and the monitor, which may run
+     * concurrently with the vCPU: they must not touch its cache.
+     */
+    bool use_pwc = cpu->cfg.pwc && !is_debug;
+    int ptshift;
     int i;
 
+    if (use_pwc) {
+        pwc_tag = root | vm | (first_stage << 4) | (two_stage << 5);
+        pwc_gtag = two_stage && first_stage ? env->hgatp : 0;
+    }
+
 #if !TCG_OVERSIZED_GUEST
 restart:
 #endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    base = root;
+    i = 0;
+    if (use_pwc) {
+        i = riscv_pwc_lookup(env, pwc_tag, pwc_gtag, addr, levels, ptidxbits,
+                             &base);
+    }
+    for (ptshift = (levels - 1 - i) * ptidxbits; i < levels;
+         i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -901,7 +1006,8 @@ restart:
 
             /* Do the second stage translation on the base PTE address. */
             int vbase_ret = get_physical_address(env, &vbase, &vbase_prot,
-                                                 base, NULL, MMU_DATA_LOAD,
+                                                 NULL, base, NULL,
+                                                 MMU_DATA_LOAD,
                                                  mmu_idx, false, true,
                                                  is_debug);
 
@@ -958,6 +1064,10 @@ restart:
                 return TRANSLATE_FAIL;
             }
             base = ppn << PGSHIFT;
+            if (use_pwc) {
+                riscv_pwc_insert(env, pwc_tag, pwc_gtag,
+                                 addr >> (PGSHIFT + ptshift), i + 1, base);
+            }
         } else if ((pte & (PTE_R | PTE_W | PTE_X)) == PTE_W) {
             /* Reserved leaf PTE flags: PTE_W */
             return TRANSLATE_FAIL;
@@ -1039,6 +1149,10 @@ restart:
             }
 
             napot_mask = (1 << napot_bits) - 1;
+            if (page_size) {
+                *page_size = (target_ulong)1 << (PGSHIFT + ptshift +
+                                                 napot_bits);
+            }
             *physical = (((ppn & ~napot_mask) | (vpn & napot_mask) |
                           (vpn & (((target_ulong)1 << ptshift) - 1))
                          ) << PGSHIFT) | (addr & ~TARGET_PAGE_MASK);
@@ -1126,14 +1240,15 @@ hwaddr riscv_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
     int prot;
     int mmu_idx = cpu_mmu_index(&cpu->env, false);
 
-    if (get_physical_address(env, &phys_addr, &prot, addr, NULL, 0, mmu_idx,
-                             true, riscv_cpu_virt_enabled(env), true)) {
+    if (get_physical_address(env, &phys_addr, &prot, NULL, addr, NULL, 0,
+                             mmu_idx, true, riscv_cpu_virt_enabled(env),
+                             true)) {
         return -1;
     }
 
     if (riscv_cpu_virt_enabled(env)) {
-        if (get_physical_address(env, &phys_addr, &prot, phys_addr, NULL,
-                                 0, mmu_idx, false, true, true)) {
+        if (get_physical_address(env, &phys_addr, &prot, NULL, phys_addr,
+                                 NULL, 0, mmu_idx, false, true, true)) {
             return -1;
         }
     }
@@ -1230,6 +1345,8 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     int mode = mmu_idx;
     /* default TLB page size */
     target_ulong tlb_size = TARGET_PAGE_SIZE;
+    /* size of the first-stage mapping, for tlb_flush_page */
+    target_ulong page_size = TARGET_PAGE_SIZE;
 
     env->guest_phys_fault_addr = 0;
 
@@ -1253,7 +1370,7 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         ((riscv_cpu_two_stage_lookup(mmu_idx) || two_stage_lookup) &&
          access_type != MMU_INST_FETCH)) {
         /* Two stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address,
+        ret = get_physical_address(env, &pa, &prot, &page_size, address,
                                    &env->guest_phys_fault_addr, access_type,
                                    mmu_idx, true, true, false);
 
@@ -1277,9 +1394,9 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
             /* Second stage lookup */
             im_address = pa;
 
-            ret = get_physical_address(env, &pa, &prot2, im_address, NULL,
-                                       access_type, mmu_idx, false, true,
-                                       false);
+            ret = get_physical_address(env, &pa, &prot2, NULL, im_address,
+                                       NULL, access_type, mmu_idx, false,
+                                       true, false);
 
             qemu_log_mask(CPU_LOG_MMU,
                     "%s 2nd-stage address=%" VADDR_PRIx " ret %d physical "
@@ -1313,8 +1430,9 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         }
     } else {
         /* Single stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address, NULL,
-                                   access_type, mmu_idx, true, false, false);
+        ret = get_physical_address(env, &pa, &prot, &page_size, address,
+                                   NULL, access_type, mmu_idx, true, false,
+                                   false);
 
         qemu_log_mask(CPU_LOG_MMU,
                       "%s address=%" VADDR_PRIx " ret %d physical "
@@ -1339,8 +1457,13 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     }
 
     if (ret == TRANSLATE_SUCCESS) {
+        /*
+         * Only this page is mapped, but sfence.vma of any address in its
+         * superpage must drop it: pass the superpage size for tlb_flush_page.
+         */
         tlb_set_page(cs, address & ~(tlb_size - 1), pa & ~(tlb_size - 1),
-                     prot, mmu_idx, tlb_size);
+                     prot, mmu_idx,
+                     tlb_size == TARGET_PAGE_SIZE ? page_size : tlb_size);
         return true;
     } else if (probe) {
         return false;
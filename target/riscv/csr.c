@@ -1233,8 +1233,11 @@ static RISCVException write_mstatus(CPURISCVState *env, int csrno,
 
     /* flush tlb on mstatus fields that affect VM */
     if ((val ^ mstatus) & (MSTATUS_MXR | MSTATUS_MPP | MSTATUS_MPV |
-            MSTATUS_MPRV | MSTATUS_SUM)) {
+            MSTATUS_MPRV)) {
         tlb_flush(env_cpu(env));
+    } else if ((val ^ mstatus) & MSTATUS_SUM) {
+        /* SUM only affects S-mode accesses, including MPRV ones from M */
+        tlb_flush_by_mmuidx(env_cpu(env), (1 << PRV_S) | (1 << PRV_M));
     }
     mask = MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_MIE | MSTATUS_MPIE |
         MSTATUS_SPP | MSTATUS_MPRV | MSTATUS_SUM |
@@ -2664,8 +2667,17 @@ static RISCVException write_satp(CPURISCVState *env, int csrno,
              * pass these through QEMU's TLB emulation as it improves
              * performance.  Flushing the TLB on SATP writes with paging
              * enabled avoids leaking those invalid cached mappings.
+             *
+             * Rather than flushing, save the TLB of the old address space:
+             * it is reused if the guest switches back before fencing it.
+             * While virtualized, satp holds vsatp, and the TLB entries of
+             * a guest are only valid for its hgatp, so flush instead.
              */
-            tlb_flush(env_cpu(env));
+            if (riscv_cpu_virt_enabled(env)) {
+                tlb_flush(env_cpu(env));
+            } else {
+                tlb_switch_context(env_cpu(env), env->satp, val);
+            }
             env->satp = val;
         }
     }
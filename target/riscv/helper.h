@@ -109,7 +109,10 @@ DEF_HELPER_1(sret, tl, env)
 DEF_HELPER_1(mret, tl, env)
 DEF_HELPER_1(wfi, void, env)
 DEF_HELPER_1(tlb_flush, void, env)
+DEF_HELPER_2(tlb_flush_page, void, env, tl)
+DEF_HELPER_2(tlb_flush_asid, void, env, tl)
 DEF_HELPER_1(tlb_flush_all, void, env)
+DEF_HELPER_2(tlb_flush_page_all, void, env, tl)
 /* Native Debug */
 DEF_HELPER_1(itrigger_match, void, env)
 #endif
@@ -625,6 +628,11 @@ DEF_HELPER_4(vmv_v_x_h, void, ptr, i64, env, i32)
 DEF_HELPER_4(vmv_v_x_w, void, ptr, i64, env, i32)
 DEF_HELPER_4(vmv_v_x_d, void, ptr, i64, env, i32)
 
+DEF_HELPER_FLAGS_2(vsel_b, TCG_CALL_NO_WG, void, env, i32)
+DEF_HELPER_FLAGS_2(vsel_h, TCG_CALL_NO_WG, void, env, i32)
+DEF_HELPER_FLAGS_2(vsel_w, TCG_CALL_NO_WG, void, env, i32)
+DEF_HELPER_FLAGS_2(vsel_d, TCG_CALL_NO_WG, void, env, i32)
+
 DEF_HELPER_6(vsaddu_vv_b, void, ptr, ptr, ptr, ptr, env, i32)
 DEF_HELPER_6(vsaddu_vv_h, void, ptr, ptr, ptr, ptr, env, i32)
 DEF_HELPER_6(vsaddu_vv_w, void, ptr, ptr, ptr, ptr, env, i32)
@@ -265,6 +265,8 @@ static int riscv_cpu_post_load(void *opaque, int version_id)
 
     env->xl = cpu_recompute_xl(env);
     riscv_cpu_update_mask(env);
+    /* The loaded RAM may hold different page tables under the same root */
+    riscv_cpu_pwc_flush(env);
     return 0;
 }
 
@@ -243,27 +243,71 @@ void helper_wfi(CPURISCVState *env)
     }
 }
 
-void helper_tlb_flush(CPURISCVState *env)
+static void check_sfence_vma(CPURISCVState *env, uintptr_t ra)
 {
-    CPUState *cs = env_cpu(env);
     if (!(env->priv >= PRV_S) ||
         (env->priv == PRV_S &&
          get_field(env->mstatus, MSTATUS_TVM))) {
-        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
+        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, ra);
     } else if (riscv_has_ext(env, RVH) && riscv_cpu_virt_enabled(env) &&
                get_field(env->hstatus, HSTATUS_VTVM)) {
-        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
-    } else {
+        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, ra);
+    }
+}
+
+void helper_tlb_flush(CPURISCVState *env)
+{
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    tlb_flush(env_cpu(env));
+}
+
+/*
+ * Unlike the ASID-only fence, this needs no special case when
+ * virtualized: tlb_flush_page drops the page from every mmu index,
+ * whichever address space filled it.
+ */
+void helper_tlb_flush_page(CPURISCVState *env, target_ulong addr)
+{
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    tlb_flush_page(env_cpu(env), addr);
+}
+
+/*
+ * The TLB of an address space is saved when satp switches away from it,
+ * so flush the saved TLBs of this ASID as well as the current one.
+ * While virtualized, the TLB may also hold translations of other ASIDs,
+ * as vsatp writes do not flush it, so flush everything.
+ */
+void helper_tlb_flush_asid(CPURISCVState *env, target_ulong asid)
+{
+    CPUState *cs = env_cpu(env);
+    target_ulong mask;
+
+    check_sfence_vma(env, GETPC());
+    riscv_cpu_pwc_flush(env);
+    if (riscv_cpu_virt_enabled(env)) {
         tlb_flush(cs);
+        return;
     }
+    mask = riscv_cpu_mxl(env) == MXL_RV32 ? SATP32_ASID : SATP64_ASID;
+    tlb_flush_context(cs, env->satp, set_field(0, mask, asid), mask);
 }
 
 void helper_tlb_flush_all(CPURISCVState *env)
 {
     CPUState *cs = env_cpu(env);
+    riscv_cpu_pwc_flush_all(env);
     tlb_flush_all_cpus_synced(cs);
 }
 
+void helper_tlb_flush_page_all(CPURISCVState *env, target_ulong addr)
+{
+    riscv_cpu_pwc_flush_all(env);
+    tlb_flush_page_all_cpus_synced(env_cpu(env), addr);
+}
+
 void helper_hyp_tlb_flush(CPURISCVState *env)
 {
     CPUState *cs = env_cpu(env);
@@ -274,6 +318,7 @@ void helper_hyp_tlb_flush(CPURISCVState *env)
 
     if (env->priv == PRV_M ||
         (env->priv == PRV_S && !riscv_cpu_virt_enabled(env))) {
+        riscv_cpu_pwc_flush(env);
         tlb_flush(cs);
         return;
     }
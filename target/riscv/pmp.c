@@ -26,7 +26,7 @@
 #include "trace.h"
 #include "exec/exec-all.h"
 
-static void pmp_write_cfg(CPURISCVState *env, uint32_t addr_index,
+static bool pmp_write_cfg(CPURISCVState *env, uint32_t addr_index,
     uint8_t val);
 static uint8_t pmp_read_cfg(CPURISCVState *env, uint32_t addr_index);
 static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index);
@@ -83,7 +83,10 @@ static inline uint8_t pmp_read_cfg(CPURISCVState *env, uint32_t pmp_index)
  * Accessor to set the cfg reg for a specific PMP/HART
  * Bounds checks and relevant lock bit.
  */
-static void pmp_write_cfg(CPURISCVState *env, uint32_t pmp_index, uint8_t val)
+/*
+ * Write a pmpcfg entry, returning true if it changed.
+ */
+static bool pmp_write_cfg(CPURISCVState *env, uint32_t pmp_index, uint8_t val)
 {
     if (pmp_index < MAX_RISCV_PMPS) {
         bool locked = true;
@@ -119,14 +122,16 @@ static void pmp_write_cfg(CPURISCVState *env, uint32_t pmp_index, uint8_t val)
 
         if (locked) {
             qemu_log_mask(LOG_GUEST_ERROR, "ignoring pmpcfg write - locked\n");
-        } else {
+        } else if (env->pmp_state.pmp[pmp_index].cfg_reg != val) {
             env->pmp_state.pmp[pmp_index].cfg_reg = val;
             pmp_update_rule(env, pmp_index);
+            return true;
         }
     } else {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "ignoring pmpcfg write - out of bounds\n");
     }
+    return false;
 }
 
 static void pmp_decode_napot(target_ulong a, target_ulong *sa, target_ulong *ea)
@@ -189,6 +194,7 @@ void pmp_update_rule_addr(CPURISCVState *env, uint32_t pmp_index)
 
     env->pmp_state.addr[pmp_index].sa = sa;
     env->pmp_state.addr[pmp_index].ea = ea;
+    env->pmp_state.map_valid = false;
 }
 
 void pmp_update_rule_nums(CPURISCVState *env)
@@ -196,6 +202,7 @@ void pmp_update_rule_nums(CPURISCVState *env)
     int i;
 
     env->pmp_state.num_rules = 0;
+    env->pmp_state.map_valid = false;
     for (i = 0; i < MAX_RISCV_PMPS; i++) {
         const uint8_t a_field =
             pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
@@ -214,6 +221,8 @@ static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index)
 {
     pmp_update_rule_addr(env, pmp_index);
     pmp_update_rule_nums(env);
+    /* The page-walk cache skips the PMP checks of the PTEs it holds */
+    riscv_cpu_pwc_flush(env);
 }
 
 static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
@@ -230,6 +239,113 @@ static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
     return result;
 }
 
+static int pmp_compare_addr(const void *a, const void *b)
+{
+    target_ulong x = *(const target_ulong *)a;
+    target_ulong y = *(const target_ulong *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Split the address space at the start and past the end of every rule,
+ * whether active or not, and record the first active rule that covers
+ * each segment.  Since no rule starts or ends inside a segment, this is
+ * the rule that the linear walk in pmp_match_rule() finds for any access
+ * within the segment.
+ */
+static void pmp_update_map(CPURISCVState *env)
+{
+    pmp_table_t *t = &env->pmp_state;
+    target_ulong bounds[PMP_MAX_SEGMENTS];
+    int i, j, n = 0;
+
+    bounds[n++] = 0;
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        bounds[n++] = t->addr[i].sa;
+        if (t->addr[i].ea != (target_ulong)-1) {
+            bounds[n++] = t->addr[i].ea + 1;
+        }
+    }
+    qsort(bounds, n, sizeof(target_ulong), pmp_compare_addr);
+
+    t->num_segments = 0;
+    for (j = 0; j < n; j++) {
+        target_ulong start = bounds[j];
+        uint8_t rule = MAX_RISCV_PMPS;
+
+        if (j > 0 && start == bounds[j - 1]) {
+            continue;
+        }
+        for (i = 0; i < MAX_RISCV_PMPS; i++) {
+            if (pmp_get_a_field(t->pmp[i].cfg_reg) != PMP_AMATCH_OFF &&
+                pmp_is_in_range(env, i, start)) {
+                rule = i;
+                break;
+            }
+        }
+        t->seg_start[t->num_segments] = start;
+        t->seg_rule[t->num_segments] = rule;
+        t->num_segments++;
+    }
+    t->map_valid = true;
+}
+
+/*
+ * Find the rule that applies to [addr, addr + size - 1].
+ * Return its index, MAX_RISCV_PMPS if no rule matches,
+ * or a negative value if the access is partially inside a rule.
+ */
+static int pmp_match_rule(CPURISCVState *env, target_ulong addr,
+                          target_ulong size)
+{
+    pmp_table_t *t = &env->pmp_state;
+    target_ulong last = addr + size - 1;
+    uint32_t lo = 0, hi;
+    int i;
+
+    if (!t->map_valid) {
+        pmp_update_map(env);
+    }
+
+    /* Find the last segment starting at or below addr. */
+    hi = t->num_segments;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (t->seg_start[mid] <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (last >= addr &&
+        (lo + 1 == t->num_segments || last < t->seg_start[lo + 1])) {
+        return t->seg_rule[lo];
+    }
+
+    /* The access spans several segments: walk the rules in order. */
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        int s = pmp_is_in_range(env, i, addr);
+        int e = pmp_is_in_range(env, i, last);
+
+        /* partially inside */
+        if ((s + e) == 1) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "pmp violation - access is partially inside\n");
+            return -1;
+        }
+
+        /* fully inside */
+        if ((s + e) == 2 &&
+            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg) !=
+            PMP_AMATCH_OFF) {
+            return i;
+        }
+    }
+    return MAX_RISCV_PMPS;
+}
+
 /*
  * Check if the address has required RWX privs when no PMP entry is matched.
  */
@@ -286,6 +402,103 @@ static bool pmp_hart_has_privs_default(CPURISCVState *env, target_ulong addr,
 }
 
 
+/*
+ * Compute the privileges that rule @i grants to an access from @mode.
+ */
+static void pmp_get_rule_privs(CPURISCVState *env, int i,
+                               pmp_priv_t *allowed_privs, target_ulong mode)
+{
+    /*
+     * Convert the PMP permissions to match the truth table in the
+     * ePMP spec.
+     */
+    const uint8_t epmp_operation =
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_LOCK) >> 4) |
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_READ) << 2) |
+        (env->pmp_state.pmp[i].cfg_reg & PMP_WRITE) |
+        ((env->pmp_state.pmp[i].cfg_reg & PMP_EXEC) >> 2);
+
+    if (!MSECCFG_MML_ISSET(env)) {
+        /*
+         * If mseccfg.MML Bit is not set, do pmp priv check
+         * This will always apply to regular PMP.
+         */
+        *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+        if ((mode != PRV_M) || pmp_is_locked(env, i)) {
+            *allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
+        }
+    } else {
+        /*
+         * If mseccfg.MML Bit set, do the enhanced pmp priv check
+         */
+        if (mode == PRV_M) {
+            switch (epmp_operation) {
+            case 0:
+            case 1:
+            case 4:
+            case 5:
+            case 6:
+            case 7:
+            case 8:
+                *allowed_privs = 0;
+                break;
+            case 2:
+            case 3:
+            case 14:
+                *allowed_privs = PMP_READ | PMP_WRITE;
+                break;
+            case 9:
+            case 10:
+                *allowed_privs = PMP_EXEC;
+                break;
+            case 11:
+            case 13:
+                *allowed_privs = PMP_READ | PMP_EXEC;
+                break;
+            case 12:
+            case 15:
+                *allowed_privs = PMP_READ;
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        } else {
+            switch (epmp_operation) {
+            case 0:
+            case 8:
+            case 9:
+            case 12:
+            case 13:
+            case 14:
+                *allowed_privs = 0;
+                break;
+            case 1:
+            case 10:
+            case 11:
+                *allowed_privs = PMP_EXEC;
+                break;
+            case 2:
+            case 4:
+            case 15:
+                *allowed_privs = PMP_READ;
+                break;
+            case 3:
+            case 6:
+                *allowed_privs = PMP_READ | PMP_WRITE;
+                break;
+            case 5:
+                *allowed_privs = PMP_READ | PMP_EXEC;
+                break;
+            case 7:
+                *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        }
+    }
+}
+
 /*
  * Public Interface
  */
@@ -303,8 +516,6 @@ int pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
     int i = 0;
     int ret = -1;
     int pmp_size = 0;
-    target_ulong s = 0;
-    target_ulong e = 0;
 
     /* Short cut if no rules */
     if (0 == pmp_get_num_rules(env)) {
@@ -330,121 +541,11 @@ int pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
 
     /* 1.10 draft priv spec states there is an implicit order
          from low to high */
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        s = pmp_is_in_range(env, i, addr);
-        e = pmp_is_in_range(env, i, addr + pmp_size - 1);
-
-        /* partially inside */
-        if ((s + e) == 1) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "pmp violation - access is partially inside\n");
-            ret = -1;
-            break;
-        }
-
-        /* fully inside */
-        const uint8_t a_field =
-            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
-
-        /*
-         * Convert the PMP permissions to match the truth table in the
-         * ePMP spec.
-         */
-        const uint8_t epmp_operation =
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_LOCK) >> 4) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_READ) << 2) |
-            (env->pmp_state.pmp[i].cfg_reg & PMP_WRITE) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_EXEC) >> 2);
-
-        if (((s + e) == 2) && (PMP_AMATCH_OFF != a_field)) {
-            /*
-             * If the PMP entry is not off and the address is in range,
-             * do the priv check
-             */
-            if (!MSECCFG_MML_ISSET(env)) {
-                /*
-                 * If mseccfg.MML Bit is not set, do pmp priv check
-                 * This will always apply to regular PMP.
-                 */
-                *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                if ((mode != PRV_M) || pmp_is_locked(env, i)) {
-                    *allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
-                }
-            } else {
-                /*
-                 * If mseccfg.MML Bit set, do the enhanced pmp priv check
-                 */
-                if (mode == PRV_M) {
-                    switch (epmp_operation) {
-                    case 0:
-                    case 1:
-                    case 4:
-                    case 5:
-                    case 6:
-                    case 7:
-                    case 8:
-                        *allowed_privs = 0;
-                        break;
-                    case 2:
-                    case 3:
-                    case 14:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 9:
-                    case 10:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 11:
-                    case 13:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 12:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                } else {
-                    switch (epmp_operation) {
-                    case 0:
-                    case 8:
-                    case 9:
-                    case 12:
-                    case 13:
-                    case 14:
-                        *allowed_privs = 0;
-                        break;
-                    case 1:
-                    case 10:
-                    case 11:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 2:
-                    case 4:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    case 3:
-                    case 6:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 5:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 7:
-                        *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                }
-            }
-
-            if ((privs & *allowed_privs) == privs) {
-                ret = i;
-            }
-            break;
+    i = pmp_match_rule(env, addr, pmp_size);
+    if (i >= 0 && i < MAX_RISCV_PMPS) {
+        pmp_get_rule_privs(env, i, allowed_privs, mode);
+        if ((privs & *allowed_privs) == privs) {
+            ret = i;
         }
     }
 
@@ -468,16 +569,19 @@ void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
     int i;
     uint8_t cfg_val;
     int pmpcfg_nums = 2 << riscv_cpu_mxl(env);
+    bool modified = false;
 
     trace_pmpcfg_csr_write(env->mhartid, reg_index, val);
 
     for (i = 0; i < pmpcfg_nums; i++) {
         cfg_val = (val >> 8 * i)  & 0xff;
-        pmp_write_cfg(env, (reg_index * 4) + i, cfg_val);
+        modified |= pmp_write_cfg(env, (reg_index * 4) + i, cfg_val);
     }
 
     /* If PMP permission of any addr has been changed, flush TLB pages. */
-    tlb_flush(env_cpu(env));
+    if (modified) {
+        tlb_flush(env_cpu(env));
+    }
 }
 
 
@@ -526,8 +630,25 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
         }
 
         if (!pmp_is_locked(env, addr_index)) {
+            bool modified = env->pmp_state.pmp[addr_index].addr_reg != val;
+
             env->pmp_state.pmp[addr_index].addr_reg = val;
             pmp_update_rule(env, addr_index);
+
+            /*
+             * The address bounds entry @addr_index and, in TOR mode, the
+             * next one: if either is active, the TLB holds pages checked
+             * against the old region, and rewriting pmpcfg with the same
+             * value will not flush them.
+             */
+            if (modified &&
+                (pmp_get_a_field(env->pmp_state.pmp[addr_index].cfg_reg) !=
+                 PMP_AMATCH_OFF ||
+                 (addr_index + 1 < MAX_RISCV_PMPS &&
+                  pmp_get_a_field(env->pmp_state.pmp[addr_index + 1].cfg_reg)
+                  == PMP_AMATCH_TOR))) {
+                tlb_flush(env_cpu(env));
+            }
         } else {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "ignoring pmpaddr write - locked\n");
@@ -580,6 +701,7 @@ void mseccfg_csr_write(CPURISCVState *env, target_ulong val)
     val |= (env->mseccfg & (MSECCFG_MMWP | MSECCFG_MML));
 
     env->mseccfg = val;
+    riscv_cpu_pwc_flush(env);
 }
 
 /*
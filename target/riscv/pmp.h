@@ -56,10 +56,23 @@ typedef struct {
     target_ulong ea;
 } pmp_addr_t;
 
+/* Every rule boundary splits a segment, plus the segment at address 0 */
+#define PMP_MAX_SEGMENTS (2 * MAX_RISCV_PMPS + 1)
+
 typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    /*
+     * The address space split at the bounds of every rule, so that each
+     * rule covers each segment either entirely or not at all, with the
+     * first active rule covering each segment.  Rebuilt on demand when
+     * the rules change, see pmp_update_map().
+     */
+    bool map_valid;
+    uint32_t num_segments;
+    target_ulong seg_start[PMP_MAX_SEGMENTS];
+    uint8_t seg_rule[PMP_MAX_SEGMENTS];
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
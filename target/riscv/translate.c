@@ -281,6 +281,36 @@ static void lookup_and_goto_ptr(DisasContext *ctx)
     tcg_gen_lookup_and_goto_ptr();
 }
 
+/*
+ * Registers x1 and x5 hold return addresses by convention, see the
+ * return-address stack prediction hints of jal and jalr.
+ */
+static bool is_link_reg(int reg)
+{
+    return reg == 1 || reg == 5;
+}
+
+/* Jump to cpu_pc, the target of jalr rd, rs1. */
+static void gen_jalr_goto_ptr(DisasContext *ctx, int rd, int rs1)
+{
+    if (is_link_reg(rd)) {
+        translator_push_return(&ctx->base, ctx->pc_succ_insn);
+    }
+
+    /*
+     * A target predicted inline must have the tb_flags of this TB.
+     * A fault-only-first load may have changed VL_EQ_VLMAX since.
+     */
+    if (ctx->itrigger ||
+        ctx->vl_eq_vlmax != FIELD_EX32(ctx->base.tb->flags,
+                                       TB_FLAGS, VL_EQ_VLMAX)) {
+        lookup_and_goto_ptr(ctx);
+        return;
+    }
+    translator_lookup_and_goto_ptr(&ctx->base, cpu_pc,
+                                   is_link_reg(rs1) && !is_link_reg(rd));
+}
+
 static void exit_tb(DisasContext *ctx)
 {
 #ifndef CONFIG_USER_ONLY
@@ -577,6 +607,14 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     }
 
     gen_set_gpri(ctx, rd, ctx->pc_succ_insn);
+    if (is_link_reg(rd)) {
+        translator_push_return(&ctx->base, ctx->pc_succ_insn);
+    }
+    if (!ctx->itrigger && translator_follow_jump(&ctx->base, next_pc)) {
+        /* Continue translating at the target of the jump. */
+        ctx->pc_succ_insn = next_pc;
+        return;
+    }
     gen_goto_tb(ctx, 0, ctx->base.pc_next + imm); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
@@ -26,6 +26,7 @@
 #include "fpu/softfloat.h"
 #include "tcg/tcg-gvec-desc.h"
 #include "internals.h"
+#include "qemu/vperm.h"
 #include <math.h>
 
 target_ulong HELPER(vsetvl)(CPURISCVState *env, target_ulong s1,
@@ -240,6 +241,8 @@ static inline int vext_elem_mask(void *v0, int index)
 /* elements operations for load and store */
 typedef void vext_ldst_elem_fn(CPURISCVState *env, target_ulong addr,
                                uint32_t idx, void *vd, uintptr_t retaddr);
+/* the same, on guest memory already resolved to a host address */
+typedef void vext_ldst_elem_host_fn(void *host, uint32_t idx, void *vd);
 
 #define GEN_VEXT_LD_ELEM(NAME, ETYPE, H, LDSUF)            \
 static void NAME(CPURISCVState *env, abi_ptr addr,         \
@@ -248,6 +251,12 @@ static void NAME(CPURISCVState *env, abi_ptr addr,         \
     ETYPE *cur = ((ETYPE *)vd + H(idx));                   \
     *cur = cpu_##LDSUF##_data_ra(env, addr, retaddr);      \
 }                                                          \
+                                                           \
+static void NAME##_host(void *host, uint32_t idx, void *vd)\
+{                                                          \
+    ETYPE *cur = ((ETYPE *)vd + H(idx));                   \
+    *cur = LDSUF##_p(host);                                \
+}
 
 GEN_VEXT_LD_ELEM(lde_b, int8_t,  H1, ldsb)
 GEN_VEXT_LD_ELEM(lde_h, int16_t, H2, ldsw)
@@ -260,6 +269,12 @@ static void NAME(CPURISCVState *env, abi_ptr addr,         \
 {                                                          \
     ETYPE data = *((ETYPE *)vd + H(idx));                  \
     cpu_##STSUF##_data_ra(env, addr, data, retaddr);       \
+}                                                          \
+                                                           \
+static void NAME##_host(void *host, uint32_t idx, void *vd)\
+{                                                          \
+    ETYPE data = *((ETYPE *)vd + H(idx));                  \
+    STSUF##_p(host, data);                                 \
 }
 
 GEN_VEXT_ST_ELEM(ste_b, int8_t,  H1, stb)
@@ -349,11 +364,173 @@ GEN_VEXT_ST_STRIDE(vsse64_v, int64_t, ste_d)
  *** unit-stride: access elements stored contiguously in memory
  */
 
+/*
+ * Return the host address of the @len bytes at @addr, which must lie
+ * within one page, raising any fault or watchpoint for the whole range.
+ * Return NULL if the bytes must be accessed one element at a time: for
+ * MMIO, for pages with watchpoints, and for stores to pages that hold
+ * translated code.
+ */
+static void *vext_probe_host(CPURISCVState *env, target_ulong addr,
+                             uint32_t len, MMUAccessType access_type,
+                             uintptr_t ra)
+{
+    int mmu_idx = cpu_mmu_index(env, false);
+    void *host = probe_access(env, addr, len, access_type, mmu_idx, ra);
+
+#ifdef CONFIG_USER_ONLY
+    return host;
+#else
+    return host ? tlb_vaddr_to_host(env, addr, access_type, mmu_idx) : NULL;
+#endif
+}
+
+/*
+ * Unit-stride accesses with a single field cover contiguous memory:
+ * look the host address up once per guest page rather than once per
+ * element.  Only the active elements of each page are probed, so that
+ * masked-off elements never fault.  Elements that straddle two pages,
+ * and pages that vext_probe_host refuses, use @ldst_elem.
+ */
+static void
+vext_ldst_us_host(void *vd, void *v0, target_ulong base,
+                  CPURISCVState *env, uint32_t desc, uint32_t vm,
+                  vext_ldst_elem_fn *ldst_elem,
+                  vext_ldst_elem_host_fn *ldst_host,
+                  uint32_t log2_esz, uint32_t evl, uintptr_t ra,
+                  MMUAccessType access_type)
+{
+    uint32_t esz = 1 << log2_esz;
+    uint32_t vma = vext_vma(desc);
+    uint32_t i = env->vstart;
+
+    while (i < evl) {
+        target_ulong addr = adjust_addr(env,
+                                        base + ((target_ulong)i << log2_esz));
+        uint32_t n = MIN(evl - i, -(addr | TARGET_PAGE_MASK) >> log2_esz);
+        uint32_t first = i, last = i + n, j;
+        void *host = NULL;
+
+        if (n == 0) {
+            /* The element straddles two pages. */
+            if (vm || vext_elem_mask(v0, i)) {
+                ldst_elem(env, addr, i, vd, ra);
+            } else {
+                vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);
+            }
+            env->vstart = ++i;
+            continue;
+        }
+
+        if (!vm) {
+            while (first < last && !vext_elem_mask(v0, first)) {
+                first++;
+            }
+            while (last > first && !vext_elem_mask(v0, last - 1)) {
+                last--;
+            }
+        }
+        if (first < last) {
+            host = vext_probe_host(env, addr + ((first - i) << log2_esz),
+                                   (last - first) << log2_esz,
+                                   access_type, ra);
+        }
+
+#ifdef CONFIG_USER_ONLY
+        /*
+         * The page may still go away under us, e.g. through munmap in
+         * another thread: let the SIGSEGV handler unwind to @ra.
+         */
+        if (host) {
+            set_helper_retaddr(ra);
+        }
+#endif
+        for (j = i; j < i + n; j++) {
+            if (!vm && !vext_elem_mask(v0, j)) {
+                /* set masked-off elements to 1s */
+                vext_set_elems_1s(vd, vma, j * esz, (j + 1) * esz);
+            } else if (host) {
+                ldst_host(host + ((j - first) << log2_esz), j, vd);
+            } else {
+                ldst_elem(env, addr + ((j - i) << log2_esz), j, vd, ra);
+                env->vstart = j + 1;
+            }
+        }
+#ifdef CONFIG_USER_ONLY
+        if (host) {
+            clear_helper_retaddr();
+        }
+#endif
+        i += n;
+        env->vstart = i;
+    }
+}
+
+/*
+ * Unmasked unit-stride segment accesses cover contiguous memory as well:
+ * the whole segments within each page are split into, or gathered from,
+ * the nf register groups by vperm_deinterleave and vperm_interleave.
+ * This relies on the register layout matching memory, i.e. on a little
+ * endian host.
+ */
+static void
+vext_ldst_us_seg_host(void *vd, target_ulong base, CPURISCVState *env,
+                      uint32_t nf, uint32_t max_elems,
+                      vext_ldst_elem_fn *ldst_elem, uint32_t log2_esz,
+                      uint32_t evl, uintptr_t ra, MMUAccessType access_type)
+{
+    uint32_t segsz = nf << log2_esz;
+    uint32_t i = env->vstart;
+    uint32_t k;
+
+    while (i < evl) {
+        target_ulong addr = adjust_addr(env, base + (target_ulong)i * segsz);
+        uint32_t n = MIN(evl - i, -(addr | TARGET_PAGE_MASK) / segsz);
+        void *host = NULL;
+
+        if (n) {
+            host = vext_probe_host(env, addr, n * segsz, access_type, ra);
+        } else {
+            /* The segment straddles two pages. */
+            n = 1;
+        }
+
+        if (host) {
+#ifdef CONFIG_USER_ONLY
+            /* As in vext_ldst_us_host, the page may still go away. */
+            set_helper_retaddr(ra);
+#endif
+            if (access_type == MMU_DATA_LOAD) {
+                vperm_deinterleave(vd + (i << log2_esz),
+                                   max_elems << log2_esz,
+                                   host, nf, 1 << log2_esz, n);
+            } else {
+                vperm_interleave(host, vd + (i << log2_esz),
+                                 max_elems << log2_esz, nf, 1 << log2_esz, n);
+            }
+#ifdef CONFIG_USER_ONLY
+            clear_helper_retaddr();
+#endif
+            i += n;
+        } else {
+            for (n += i; i < n; i++, env->vstart++) {
+                for (k = 0; k < nf; k++) {
+                    ldst_elem(env, adjust_addr(env, base +
+                                               ((i * nf + k) << log2_esz)),
+                              i + k * max_elems, vd, ra);
+                }
+            }
+        }
+        env->vstart = i;
+    }
+}
+
 /* unmasked unit-stride load and store operation*/
 static void
-vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
-             vext_ldst_elem_fn *ldst_elem, uint32_t log2_esz, uint32_t evl,
-             uintptr_t ra)
+vext_ldst_us(void *vd, void *v0, target_ulong base, CPURISCVState *env,
+             uint32_t desc, uint32_t vm, vext_ldst_elem_fn *ldst_elem,
+             vext_ldst_elem_host_fn *ldst_host, uint32_t log2_esz,
+             uint32_t evl, uintptr_t ra, MMUAccessType access_type)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
@@ -362,13 +539,22 @@ vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
     uint32_t total_elems = vext_get_total_elems(env, desc, esz);
     uint32_t vta = vext_vta(desc);
 
-    /* load bytes from guest memory */
-    for (i = env->vstart; i < evl; i++, env->vstart++) {
-        k = 0;
-        while (k < nf) {
-            target_ulong addr = base + ((i * nf + k) << log2_esz);
-            ldst_elem(env, adjust_addr(env, addr), i + k * max_elems, vd, ra);
-            k++;
+    if (nf == 1) {
+        vext_ldst_us_host(vd, v0, base, env, desc, vm, ldst_elem, ldst_host,
+                          log2_esz, evl, ra, access_type);
+    } else if (vm && !HOST_BIG_ENDIAN) {
+        vext_ldst_us_seg_host(vd, base, env, nf, max_elems, ldst_elem,
+                              log2_esz, evl, ra, access_type);
+    } else {
+        /* load bytes from guest memory */
+        for (i = env->vstart; i < evl; i++, env->vstart++) {
+            k = 0;
+            while (k < nf) {
+                target_ulong addr = base + ((i * nf + k) << log2_esz);
+                ldst_elem(env, adjust_addr(env, addr), i + k * max_elems,
+                          vd, ra);
+                k++;
+            }
         }
     }
     env->vstart = 0;
@@ -388,7 +574,7 @@ vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
 
 /*
  * masked unit-stride load and store operation will be a special case of stride,
- * stride = NF * sizeof (MTYPE)
+ * stride = NF * sizeof (MTYPE), unless there is a single field.
  */
 
 #define GEN_VEXT_LD_US(NAME, ETYPE, LOAD_FN)                            \
@@ -396,6 +582,13 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,         \
                          CPURISCVState *env, uint32_t desc)             \
 {                                                                       \
     uint32_t stride = vext_nf(desc) << ctzl(sizeof(ETYPE));             \
+                                                                        \
+    if (vext_nf(desc) == 1) {                                           \
+        vext_ldst_us(vd, v0, base, env, desc, false, LOAD_FN,           \
+                     LOAD_FN##_host, ctzl(sizeof(ETYPE)), env->vl,      \
+                     GETPC(), MMU_DATA_LOAD);                           \
+        return;                                                         \
+    }                                                                   \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false, LOAD_FN,   \
                      ctzl(sizeof(ETYPE)), GETPC());                     \
 }                                                                       \
@@ -403,8 +596,9 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,         \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   CPURISCVState *env, uint32_t desc)                    \
 {                                                                       \
-    vext_ldst_us(vd, base, env, desc, LOAD_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                \
+    vext_ldst_us(vd, v0, base, env, desc, true, LOAD_FN,                \
+                 LOAD_FN##_host, ctzl(sizeof(ETYPE)), env->vl,          \
+                 GETPC(), MMU_DATA_LOAD);                               \
 }
 
 GEN_VEXT_LD_US(vle8_v,  int8_t,  lde_b)
@@ -417,6 +611,13 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,          \
                          CPURISCVState *env, uint32_t desc)              \
 {                                                                        \
     uint32_t stride = vext_nf(desc) << ctzl(sizeof(ETYPE));              \
+                                                                         \
+    if (vext_nf(desc) == 1) {                                            \
+        vext_ldst_us(vd, v0, base, env, desc, false, STORE_FN,           \
+                     STORE_FN##_host, ctzl(sizeof(ETYPE)), env->vl,      \
+                     GETPC(), MMU_DATA_STORE);                           \
+        return;                                                          \
+    }                                                                    \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false, STORE_FN,   \
                      ctzl(sizeof(ETYPE)), GETPC());                      \
 }                                                                        \
@@ -424,8 +625,9 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,          \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                 \
                   CPURISCVState *env, uint32_t desc)                     \
 {                                                                        \
-    vext_ldst_us(vd, base, env, desc, STORE_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                 \
+    vext_ldst_us(vd, v0, base, env, desc, true, STORE_FN,                \
+                 STORE_FN##_host, ctzl(sizeof(ETYPE)), env->vl,          \
+                 GETPC(), MMU_DATA_STORE);                               \
 }
 
 GEN_VEXT_ST_US(vse8_v,  int8_t,  ste_b)
@@ -441,8 +643,8 @@ void HELPER(vlm_v)(void *vd, void *v0, target_ulong base,
 {
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
-    vext_ldst_us(vd, base, env, desc, lde_b,
-                 0, evl, GETPC());
+    vext_ldst_us(vd, v0, base, env, desc, true, lde_b, lde_b_host,
+                 0, evl, GETPC(), MMU_DATA_LOAD);
 }
 
 void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
@@ -450,8 +652,8 @@ void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
 {
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
-    vext_ldst_us(vd, base, env, desc, ste_b,
-                 0, evl, GETPC());
+    vext_ldst_us(vd, v0, base, env, desc, true, ste_b, ste_b_host,
+                 0, evl, GETPC(), MMU_DATA_STORE);
 }
 
 /*
@@ -761,6 +963,38 @@ GEN_VEXT_ST_WHOLE(vs2r_v, int8_t, ste_b)
 GEN_VEXT_ST_WHOLE(vs4r_v, int8_t, ste_b)
 GEN_VEXT_ST_WHOLE(vs8r_v, int8_t, ste_b)
 
+/*
+ * Element masks for the inline expansion of masked, tail-undisturbed
+ * and partial-length operations (see gen_vext_merge): vsel selects the
+ * active elements, vones the masked-off and tail elements that the
+ * agnostic policies set to 1s.  desc covers the register group only.
+ */
+#define GEN_VEXT_SEL(NAME, ETYPE, H)                                  \
+void HELPER(NAME)(CPURISCVState *env, uint32_t desc)                  \
+{                                                                     \
+    ETYPE *sel = (ETYPE *)env->vsel;                                  \
+    ETYPE *ones = (ETYPE *)env->vones;                                \
+    uint32_t total_elems = simd_maxsz(desc) / sizeof(ETYPE);          \
+    uint32_t vm = vext_vm(desc);                                      \
+    uint32_t vta = vext_vta(desc);                                    \
+    uint32_t vma = vext_vma(desc);                                    \
+    uint32_t i;                                                       \
+                                                                      \
+    for (i = 0; i < total_elems; i++) {                               \
+        bool body = i >= env->vstart && i < env->vl;                  \
+        bool active = body && (vm || vext_elem_mask(env->vreg, i));   \
+                                                                      \
+        sel[H(i)] = active ? -1 : 0;                                  \
+        ones[H(i)] = (body ? !active && vma : i >= env->vl && vta)    \
+                     ? -1 : 0;                                        \
+    }                                                                 \
+}
+
+GEN_VEXT_SEL(vsel_b, uint8_t,  H1)
+GEN_VEXT_SEL(vsel_h, uint16_t, H2)
+GEN_VEXT_SEL(vsel_w, uint32_t, H4)
+GEN_VEXT_SEL(vsel_d, uint64_t, H8)
+
 /*
  *** Vector Integer Arithmetic Instructions
  */
@@ -3055,12 +3289,72 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
                       total_elems * ESZ);                 \
 }
 
+/*
+ * Unmasked single-width operations on 32 and 64-bit elements go through
+ * the batch functions of softfloat, which compute runs of elements on the
+ * host FPU, with the same results and flags as the element loop.  This
+ * relies on the register layout matching memory, i.e. on a little endian
+ * host.  BATCH is called on the elements from vstart on, with vs1
+ * pointing to the scalar operand if s1_scalar.
+ */
+
+#define GEN_VEXT_VV_ENV_BATCH(NAME, ESZ, BATCH)           \
+void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
+                  void *vs2, CPURISCVState *env,          \
+                  uint32_t desc)                          \
+{                                                         \
+    uint32_t vm = vext_vm(desc);                          \
+    uint32_t vl = env->vl;                                \
+    uint32_t total_elems =                                \
+        vext_get_total_elems(env, desc, ESZ);             \
+    uint32_t vta = vext_vta(desc);                        \
+    uint32_t vma = vext_vma(desc);                        \
+    uint32_t i = env->vstart;                             \
+                                                          \
+    if (vm && !HOST_BIG_ENDIAN) {                         \
+        if (i < vl) {                                     \
+            BATCH(vd + i * ESZ, vs1 + i * ESZ,            \
+                  vs2 + i * ESZ, false, vl - i,           \
+                  &env->fp_status);                       \
+        }                                                 \
+    } else {                                              \
+        for (; i < vl; i++) {                             \
+            if (!vm && !vext_elem_mask(v0, i)) {          \
+                /* set masked-off elements to 1s */       \
+                vext_set_elems_1s(vd, vma, i * ESZ,       \
+                                  (i + 1) * ESZ);         \
+                continue;                                 \
+            }                                             \
+            do_##NAME(vd, vs1, vs2, i, env);              \
+        }                                                 \
+    }                                                     \
+    env->vstart = 0;                                      \
+    /* set tail elements to 1s */                         \
+    vext_set_elems_1s(vd, vta, vl * ESZ,                  \
+                      total_elems * ESZ);                 \
+}
+
+/* vd[i] = vs2[i] op vs1[i] */
+#define GEN_FBATCH_OP2(NAME, BITS, OP)                                   \
+static void NAME(void *vd, void *vs1, void *vs2, bool s1_scalar,         \
+                 uint32_t n, float_status *s)                            \
+{                                                                        \
+    float##BITS##_##OP##_n(vd, vs2, vs1, s1_scalar, n, s);               \
+}
+
+GEN_FBATCH_OP2(fadd32_n, 32, add)
+GEN_FBATCH_OP2(fadd64_n, 64, add)
+GEN_FBATCH_OP2(fsub32_n, 32, sub)
+GEN_FBATCH_OP2(fsub64_n, 64, sub)
+GEN_FBATCH_OP2(fmul32_n, 32, mul)
+GEN_FBATCH_OP2(fmul64_n, 64, mul)
+
 RVVCALL(OPFVV2, vfadd_vv_h, OP_UUU_H, H2, H2, H2, float16_add)
 RVVCALL(OPFVV2, vfadd_vv_w, OP_UUU_W, H4, H4, H4, float32_add)
 RVVCALL(OPFVV2, vfadd_vv_d, OP_UUU_D, H8, H8, H8, float64_add)
 GEN_VEXT_VV_ENV(vfadd_vv_h, 2)
-GEN_VEXT_VV_ENV(vfadd_vv_w, 4)
-GEN_VEXT_VV_ENV(vfadd_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfadd_vv_w, 4, fadd32_n)
+GEN_VEXT_VV_ENV_BATCH(vfadd_vv_d, 8, fadd64_n)
 
 #define OPFVF2(NAME, TD, T1, T2, TX1, TX2, HD, HS2, OP)        \
 static void do_##NAME(void *vd, uint64_t s1, void *vs2, int i, \
@@ -3098,25 +3392,60 @@ void HELPER(NAME)(void *vd, void *v0, uint64_t s1,        \
                       total_elems * ESZ);                 \
 }
 
+#define GEN_VEXT_VF_BATCH(NAME, ETYPE, BATCH)                   \
+void HELPER(NAME)(void *vd, void *v0, uint64_t s1,              \
+                  void *vs2, CPURISCVState *env,                \
+                  uint32_t desc)                                \
+{                                                               \
+    uint32_t esz = sizeof(ETYPE);                               \
+    uint32_t vm = vext_vm(desc);                                \
+    uint32_t vl = env->vl;                                      \
+    uint32_t total_elems = vext_get_total_elems(env, desc, esz); \
+    uint32_t vta = vext_vta(desc);                              \
+    uint32_t vma = vext_vma(desc);                              \
+    uint32_t i = env->vstart;                                   \
+    ETYPE e1 = s1;                                              \
+                                                                \
+    if (vm && !HOST_BIG_ENDIAN) {                               \
+        if (i < vl) {                                           \
+            BATCH(vd + i * esz, &e1, vs2 + i * esz, true,       \
+                  vl - i, &env->fp_status);                     \
+        }                                                       \
+    } else {                                                    \
+        for (; i < vl; i++) {                                   \
+            if (!vm && !vext_elem_mask(v0, i)) {                \
+                /* set masked-off elements to 1s */             \
+                vext_set_elems_1s(vd, vma, i * esz,             \
+                                  (i + 1) * esz);               \
+                continue;                                       \
+            }                                                   \
+            do_##NAME(vd, s1, vs2, i, env);                     \
+        }                                                       \
+    }                                                           \
+    env->vstart = 0;                                            \
+    /* set tail elements to 1s */                               \
+    vext_set_elems_1s(vd, vta, vl * esz, total_elems * esz);    \
+}
+
 RVVCALL(OPFVF2, vfadd_vf_h, OP_UUU_H, H2, H2, float16_add)
 RVVCALL(OPFVF2, vfadd_vf_w, OP_UUU_W, H4, H4, float32_add)
 RVVCALL(OPFVF2, vfadd_vf_d, OP_UUU_D, H8, H8, float64_add)
 GEN_VEXT_VF(vfadd_vf_h, 2)
-GEN_VEXT_VF(vfadd_vf_w, 4)
-GEN_VEXT_VF(vfadd_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfadd_vf_w, uint32_t, fadd32_n)
+GEN_VEXT_VF_BATCH(vfadd_vf_d, uint64_t, fadd64_n)
 
 RVVCALL(OPFVV2, vfsub_vv_h, OP_UUU_H, H2, H2, H2, float16_sub)
 RVVCALL(OPFVV2, vfsub_vv_w, OP_UUU_W, H4, H4, H4, float32_sub)
 RVVCALL(OPFVV2, vfsub_vv_d, OP_UUU_D, H8, H8, H8, float64_sub)
 GEN_VEXT_VV_ENV(vfsub_vv_h, 2)
-GEN_VEXT_VV_ENV(vfsub_vv_w, 4)
-GEN_VEXT_VV_ENV(vfsub_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfsub_vv_w, 4, fsub32_n)
+GEN_VEXT_VV_ENV_BATCH(vfsub_vv_d, 8, fsub64_n)
 RVVCALL(OPFVF2, vfsub_vf_h, OP_UUU_H, H2, H2, float16_sub)
 RVVCALL(OPFVF2, vfsub_vf_w, OP_UUU_W, H4, H4, float32_sub)
 RVVCALL(OPFVF2, vfsub_vf_d, OP_UUU_D, H8, H8, float64_sub)
 GEN_VEXT_VF(vfsub_vf_h, 2)
-GEN_VEXT_VF(vfsub_vf_w, 4)
-GEN_VEXT_VF(vfsub_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfsub_vf_w, uint32_t, fsub32_n)
+GEN_VEXT_VF_BATCH(vfsub_vf_d, uint64_t, fsub64_n)
 
 static uint16_t float16_rsub(uint16_t a, uint16_t b, float_status *s)
 {
@@ -3228,14 +3557,14 @@ RVVCALL(OPFVV2, vfmul_vv_h, OP_UUU_H, H2, H2, H2, float16_mul)
 RVVCALL(OPFVV2, vfmul_vv_w, OP_UUU_W, H4, H4, H4, float32_mul)
 RVVCALL(OPFVV2, vfmul_vv_d, OP_UUU_D, H8, H8, H8, float64_mul)
 GEN_VEXT_VV_ENV(vfmul_vv_h, 2)
-GEN_VEXT_VV_ENV(vfmul_vv_w, 4)
-GEN_VEXT_VV_ENV(vfmul_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfmul_vv_w, 4, fmul32_n)
+GEN_VEXT_VV_ENV_BATCH(vfmul_vv_d, 8, fmul64_n)
 RVVCALL(OPFVF2, vfmul_vf_h, OP_UUU_H, H2, H2, float16_mul)
 RVVCALL(OPFVF2, vfmul_vf_w, OP_UUU_W, H4, H4, float32_mul)
 RVVCALL(OPFVF2, vfmul_vf_d, OP_UUU_D, H8, H8, float64_mul)
 GEN_VEXT_VF(vfmul_vf_h, 2)
-GEN_VEXT_VF(vfmul_vf_w, 4)
-GEN_VEXT_VF(vfmul_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfmul_vf_w, uint32_t, fmul32_n)
+GEN_VEXT_VF_BATCH(vfmul_vf_d, uint64_t, fmul64_n)
 
 RVVCALL(OPFVV2, vfdiv_vv_h, OP_UUU_H, H2, H2, H2, float16_div)
 RVVCALL(OPFVV2, vfdiv_vv_w, OP_UUU_W, H4, H4, H4, float32_div)
@@ -3305,6 +3634,14 @@ static void do_##NAME(void *vd, void *vs1, void *vs2, int i,       \
     *((TD *)vd + HD(i)) = OP(s2, s1, d, &env->fp_status);          \
 }
 
+/* vd[i] = +-(vs1[i] * vs2[i]) +- vd[i] */
+#define GEN_FBATCH_MACC(NAME, BITS, FLAGS)                               \
+static void NAME(void *vd, void *vs1, void *vs2, bool s1_scalar,         \
+                 uint32_t n, float_status *s)                            \
+{                                                                        \
+    float##BITS##_muladd_n(vd, vs2, vs1, s1_scalar, vd, FLAGS, n, s);    \
+}
+
 static uint16_t fmacc16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
     return float16_muladd(a, b, d, 0, s);
@@ -3320,12 +3657,15 @@ static uint64_t fmacc64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(a, b, d, 0, s);
 }
 
+GEN_FBATCH_MACC(fmacc32_n, 32, 0)
+GEN_FBATCH_MACC(fmacc64_n, 64, 0)
+
 RVVCALL(OPFVV3, vfmacc_vv_h, OP_UUU_H, H2, H2, H2, fmacc16)
 RVVCALL(OPFVV3, vfmacc_vv_w, OP_UUU_W, H4, H4, H4, fmacc32)
 RVVCALL(OPFVV3, vfmacc_vv_d, OP_UUU_D, H8, H8, H8, fmacc64)
 GEN_VEXT_VV_ENV(vfmacc_vv_h, 2)
-GEN_VEXT_VV_ENV(vfmacc_vv_w, 4)
-GEN_VEXT_VV_ENV(vfmacc_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfmacc_vv_w, 4, fmacc32_n)
+GEN_VEXT_VV_ENV_BATCH(vfmacc_vv_d, 8, fmacc64_n)
 
 #define OPFVF3(NAME, TD, T1, T2, TX1, TX2, HD, HS2, OP)           \
 static void do_##NAME(void *vd, uint64_t s1, void *vs2, int i,    \
@@ -3340,8 +3680,8 @@ RVVCALL(OPFVF3, vfmacc_vf_h, OP_UUU_H, H2, H2, fmacc16)
 RVVCALL(OPFVF3, vfmacc_vf_w, OP_UUU_W, H4, H4, fmacc32)
 RVVCALL(OPFVF3, vfmacc_vf_d, OP_UUU_D, H8, H8, fmacc64)
 GEN_VEXT_VF(vfmacc_vf_h, 2)
-GEN_VEXT_VF(vfmacc_vf_w, 4)
-GEN_VEXT_VF(vfmacc_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfmacc_vf_w, uint32_t, fmacc32_n)
+GEN_VEXT_VF_BATCH(vfmacc_vf_d, uint64_t, fmacc64_n)
 
 static uint16_t fnmacc16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3361,18 +3701,23 @@ static uint64_t fnmacc64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
             float_muladd_negate_c | float_muladd_negate_product, s);
 }
 
+GEN_FBATCH_MACC(fnmacc32_n, 32,
+                float_muladd_negate_c | float_muladd_negate_product)
+GEN_FBATCH_MACC(fnmacc64_n, 64,
+                float_muladd_negate_c | float_muladd_negate_product)
+
 RVVCALL(OPFVV3, vfnmacc_vv_h, OP_UUU_H, H2, H2, H2, fnmacc16)
 RVVCALL(OPFVV3, vfnmacc_vv_w, OP_UUU_W, H4, H4, H4, fnmacc32)
 RVVCALL(OPFVV3, vfnmacc_vv_d, OP_UUU_D, H8, H8, H8, fnmacc64)
 GEN_VEXT_VV_ENV(vfnmacc_vv_h, 2)
-GEN_VEXT_VV_ENV(vfnmacc_vv_w, 4)
-GEN_VEXT_VV_ENV(vfnmacc_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfnmacc_vv_w, 4, fnmacc32_n)
+GEN_VEXT_VV_ENV_BATCH(vfnmacc_vv_d, 8, fnmacc64_n)
 RVVCALL(OPFVF3, vfnmacc_vf_h, OP_UUU_H, H2, H2, fnmacc16)
 RVVCALL(OPFVF3, vfnmacc_vf_w, OP_UUU_W, H4, H4, fnmacc32)
 RVVCALL(OPFVF3, vfnmacc_vf_d, OP_UUU_D, H8, H8, fnmacc64)
 GEN_VEXT_VF(vfnmacc_vf_h, 2)
-GEN_VEXT_VF(vfnmacc_vf_w, 4)
-GEN_VEXT_VF(vfnmacc_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfnmacc_vf_w, uint32_t, fnmacc32_n)
+GEN_VEXT_VF_BATCH(vfnmacc_vf_d, uint64_t, fnmacc64_n)
 
 static uint16_t fmsac16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3389,18 +3734,21 @@ static uint64_t fmsac64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(a, b, d, float_muladd_negate_c, s);
 }
 
+GEN_FBATCH_MACC(fmsac32_n, 32, float_muladd_negate_c)
+GEN_FBATCH_MACC(fmsac64_n, 64, float_muladd_negate_c)
+
 RVVCALL(OPFVV3, vfmsac_vv_h, OP_UUU_H, H2, H2, H2, fmsac16)
 RVVCALL(OPFVV3, vfmsac_vv_w, OP_UUU_W, H4, H4, H4, fmsac32)
 RVVCALL(OPFVV3, vfmsac_vv_d, OP_UUU_D, H8, H8, H8, fmsac64)
 GEN_VEXT_VV_ENV(vfmsac_vv_h, 2)
-GEN_VEXT_VV_ENV(vfmsac_vv_w, 4)
-GEN_VEXT_VV_ENV(vfmsac_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfmsac_vv_w, 4, fmsac32_n)
+GEN_VEXT_VV_ENV_BATCH(vfmsac_vv_d, 8, fmsac64_n)
 RVVCALL(OPFVF3, vfmsac_vf_h, OP_UUU_H, H2, H2, fmsac16)
 RVVCALL(OPFVF3, vfmsac_vf_w, OP_UUU_W, H4, H4, fmsac32)
 RVVCALL(OPFVF3, vfmsac_vf_d, OP_UUU_D, H8, H8, fmsac64)
 GEN_VEXT_VF(vfmsac_vf_h, 2)
-GEN_VEXT_VF(vfmsac_vf_w, 4)
-GEN_VEXT_VF(vfmsac_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfmsac_vf_w, uint32_t, fmsac32_n)
+GEN_VEXT_VF_BATCH(vfmsac_vf_d, uint64_t, fmsac64_n)
 
 static uint16_t fnmsac16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3417,18 +3765,29 @@ static uint64_t fnmsac64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(a, b, d, float_muladd_negate_product, s);
 }
 
+GEN_FBATCH_MACC(fnmsac32_n, 32, float_muladd_negate_product)
+GEN_FBATCH_MACC(fnmsac64_n, 64, float_muladd_negate_product)
+
 RVVCALL(OPFVV3, vfnmsac_vv_h, OP_UUU_H, H2, H2, H2, fnmsac16)
 RVVCALL(OPFVV3, vfnmsac_vv_w, OP_UUU_W, H4, H4, H4, fnmsac32)
 RVVCALL(OPFVV3, vfnmsac_vv_d, OP_UUU_D, H8, H8, H8, fnmsac64)
 GEN_VEXT_VV_ENV(vfnmsac_vv_h, 2)
-GEN_VEXT_VV_ENV(vfnmsac_vv_w, 4)
-GEN_VEXT_VV_ENV(vfnmsac_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfnmsac_vv_w, 4, fnmsac32_n)
+GEN_VEXT_VV_ENV_BATCH(vfnmsac_vv_d, 8, fnmsac64_n)
 RVVCALL(OPFVF3, vfnmsac_vf_h, OP_UUU_H, H2, H2, fnmsac16)
 RVVCALL(OPFVF3, vfnmsac_vf_w, OP_UUU_W, H4, H4, fnmsac32)
 RVVCALL(OPFVF3, vfnmsac_vf_d, OP_UUU_D, H8, H8, fnmsac64)
 GEN_VEXT_VF(vfnmsac_vf_h, 2)
-GEN_VEXT_VF(vfnmsac_vf_w, 4)
-GEN_VEXT_VF(vfnmsac_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfnmsac_vf_w, uint32_t, fnmsac32_n)
+GEN_VEXT_VF_BATCH(vfnmsac_vf_d, uint64_t, fnmsac64_n)
+
+/* vd[i] = +-(vs1[i] * vd[i]) +- vs2[i] */
+#define GEN_FBATCH_MADD(NAME, BITS, FLAGS)                               \
+static void NAME(void *vd, void *vs1, void *vs2, bool s1_scalar,         \
+                 uint32_t n, float_status *s)                            \
+{                                                                        \
+    float##BITS##_muladd_n(vd, vd, vs1, s1_scalar, vs2, FLAGS, n, s);    \
+}
 
 static uint16_t fmadd16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3445,18 +3804,21 @@ static uint64_t fmadd64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(d, b, a, 0, s);
 }
 
+GEN_FBATCH_MADD(fmadd32_n, 32, 0)
+GEN_FBATCH_MADD(fmadd64_n, 64, 0)
+
 RVVCALL(OPFVV3, vfmadd_vv_h, OP_UUU_H, H2, H2, H2, fmadd16)
 RVVCALL(OPFVV3, vfmadd_vv_w, OP_UUU_W, H4, H4, H4, fmadd32)
 RVVCALL(OPFVV3, vfmadd_vv_d, OP_UUU_D, H8, H8, H8, fmadd64)
 GEN_VEXT_VV_ENV(vfmadd_vv_h, 2)
-GEN_VEXT_VV_ENV(vfmadd_vv_w, 4)
-GEN_VEXT_VV_ENV(vfmadd_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfmadd_vv_w, 4, fmadd32_n)
+GEN_VEXT_VV_ENV_BATCH(vfmadd_vv_d, 8, fmadd64_n)
 RVVCALL(OPFVF3, vfmadd_vf_h, OP_UUU_H, H2, H2, fmadd16)
 RVVCALL(OPFVF3, vfmadd_vf_w, OP_UUU_W, H4, H4, fmadd32)
 RVVCALL(OPFVF3, vfmadd_vf_d, OP_UUU_D, H8, H8, fmadd64)
 GEN_VEXT_VF(vfmadd_vf_h, 2)
-GEN_VEXT_VF(vfmadd_vf_w, 4)
-GEN_VEXT_VF(vfmadd_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfmadd_vf_w, uint32_t, fmadd32_n)
+GEN_VEXT_VF_BATCH(vfmadd_vf_d, uint64_t, fmadd64_n)
 
 static uint16_t fnmadd16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3476,18 +3838,23 @@ static uint64_t fnmadd64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
             float_muladd_negate_c | float_muladd_negate_product, s);
 }
 
+GEN_FBATCH_MADD(fnmadd32_n, 32,
+                float_muladd_negate_c | float_muladd_negate_product)
+GEN_FBATCH_MADD(fnmadd64_n, 64,
+                float_muladd_negate_c | float_muladd_negate_product)
+
 RVVCALL(OPFVV3, vfnmadd_vv_h, OP_UUU_H, H2, H2, H2, fnmadd16)
 RVVCALL(OPFVV3, vfnmadd_vv_w, OP_UUU_W, H4, H4, H4, fnmadd32)
 RVVCALL(OPFVV3, vfnmadd_vv_d, OP_UUU_D, H8, H8, H8, fnmadd64)
 GEN_VEXT_VV_ENV(vfnmadd_vv_h, 2)
-GEN_VEXT_VV_ENV(vfnmadd_vv_w, 4)
-GEN_VEXT_VV_ENV(vfnmadd_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfnmadd_vv_w, 4, fnmadd32_n)
+GEN_VEXT_VV_ENV_BATCH(vfnmadd_vv_d, 8, fnmadd64_n)
 RVVCALL(OPFVF3, vfnmadd_vf_h, OP_UUU_H, H2, H2, fnmadd16)
 RVVCALL(OPFVF3, vfnmadd_vf_w, OP_UUU_W, H4, H4, fnmadd32)
 RVVCALL(OPFVF3, vfnmadd_vf_d, OP_UUU_D, H8, H8, fnmadd64)
 GEN_VEXT_VF(vfnmadd_vf_h, 2)
-GEN_VEXT_VF(vfnmadd_vf_w, 4)
-GEN_VEXT_VF(vfnmadd_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfnmadd_vf_w, uint32_t, fnmadd32_n)
+GEN_VEXT_VF_BATCH(vfnmadd_vf_d, uint64_t, fnmadd64_n)
 
 static uint16_t fmsub16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3504,18 +3871,21 @@ static uint64_t fmsub64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(d, b, a, float_muladd_negate_c, s);
 }
 
+GEN_FBATCH_MADD(fmsub32_n, 32, float_muladd_negate_c)
+GEN_FBATCH_MADD(fmsub64_n, 64, float_muladd_negate_c)
+
 RVVCALL(OPFVV3, vfmsub_vv_h, OP_UUU_H, H2, H2, H2, fmsub16)
 RVVCALL(OPFVV3, vfmsub_vv_w, OP_UUU_W, H4, H4, H4, fmsub32)
 RVVCALL(OPFVV3, vfmsub_vv_d, OP_UUU_D, H8, H8, H8, fmsub64)
 GEN_VEXT_VV_ENV(vfmsub_vv_h, 2)
-GEN_VEXT_VV_ENV(vfmsub_vv_w, 4)
-GEN_VEXT_VV_ENV(vfmsub_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfmsub_vv_w, 4, fmsub32_n)
+GEN_VEXT_VV_ENV_BATCH(vfmsub_vv_d, 8, fmsub64_n)
 RVVCALL(OPFVF3, vfmsub_vf_h, OP_UUU_H, H2, H2, fmsub16)
 RVVCALL(OPFVF3, vfmsub_vf_w, OP_UUU_W, H4, H4, fmsub32)
 RVVCALL(OPFVF3, vfmsub_vf_d, OP_UUU_D, H8, H8, fmsub64)
 GEN_VEXT_VF(vfmsub_vf_h, 2)
-GEN_VEXT_VF(vfmsub_vf_w, 4)
-GEN_VEXT_VF(vfmsub_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfmsub_vf_w, uint32_t, fmsub32_n)
+GEN_VEXT_VF_BATCH(vfmsub_vf_d, uint64_t, fmsub64_n)
 
 static uint16_t fnmsub16(uint16_t a, uint16_t b, uint16_t d, float_status *s)
 {
@@ -3532,18 +3902,21 @@ static uint64_t fnmsub64(uint64_t a, uint64_t b, uint64_t d, float_status *s)
     return float64_muladd(d, b, a, float_muladd_negate_product, s);
 }
 
+GEN_FBATCH_MADD(fnmsub32_n, 32, float_muladd_negate_product)
+GEN_FBATCH_MADD(fnmsub64_n, 64, float_muladd_negate_product)
+
 RVVCALL(OPFVV3, vfnmsub_vv_h, OP_UUU_H, H2, H2, H2, fnmsub16)
 RVVCALL(OPFVV3, vfnmsub_vv_w, OP_UUU_W, H4, H4, H4, fnmsub32)
 RVVCALL(OPFVV3, vfnmsub_vv_d, OP_UUU_D, H8, H8, H8, fnmsub64)
 GEN_VEXT_VV_ENV(vfnmsub_vv_h, 2)
-GEN_VEXT_VV_ENV(vfnmsub_vv_w, 4)
-GEN_VEXT_VV_ENV(vfnmsub_vv_d, 8)
+GEN_VEXT_VV_ENV_BATCH(vfnmsub_vv_w, 4, fnmsub32_n)
+GEN_VEXT_VV_ENV_BATCH(vfnmsub_vv_d, 8, fnmsub64_n)
 RVVCALL(OPFVF3, vfnmsub_vf_h, OP_UUU_H, H2, H2, fnmsub16)
 RVVCALL(OPFVF3, vfnmsub_vf_w, OP_UUU_W, H4, H4, fnmsub32)
 RVVCALL(OPFVF3, vfnmsub_vf_d, OP_UUU_D, H8, H8, fnmsub64)
 GEN_VEXT_VF(vfnmsub_vf_h, 2)
-GEN_VEXT_VF(vfnmsub_vf_w, 4)
-GEN_VEXT_VF(vfnmsub_vf_d, 8)
+GEN_VEXT_VF_BATCH(vfnmsub_vf_w, uint32_t, fnmsub32_n)
+GEN_VEXT_VF_BATCH(vfnmsub_vf_d, uint64_t, fnmsub64_n)
 
 /* Vector Widening Floating-Point Fused Multiply-Add Instructions */
 static uint32_t fwmacc16(uint16_t a, uint16_t b, uint32_t d, float_status *s)
@@ -4699,10 +5072,47 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1,           \
     vext_set_elems_1s(vd, vta, esz, vlenb);                \
 }
 
+/*
+ * The unordered sum may be computed in any order, so the unmasked ones on
+ * 32 and 64-bit elements use the partial sums of SUM_N.
+ */
+#define GEN_VEXT_FREDUSUM(NAME, TD, H, OP, SUM_N)          \
+void HELPER(NAME)(void *vd, void *v0, void *vs1,           \
+                  void *vs2, CPURISCVState *env,           \
+                  uint32_t desc)                           \
+{                                                          \
+    uint32_t vm = vext_vm(desc);                           \
+    uint32_t vl = env->vl;                                 \
+    uint32_t esz = sizeof(TD);                             \
+    uint32_t vlenb = simd_maxsz(desc);                     \
+    uint32_t vta = vext_vta(desc);                         \
+    uint32_t i = env->vstart;                              \
+    TD s1 =  *((TD *)vs1 + H(0));                          \
+                                                           \
+    if (vm && !HOST_BIG_ENDIAN) {                          \
+        if (i < vl) {                                      \
+            s1 = SUM_N(s1, (TD *)vs2 + i, vl - i,          \
+                       &env->fp_status);                   \
+        }                                                  \
+    } else {                                               \
+        for (; i < vl; i++) {                              \
+            if (!vm && !vext_elem_mask(v0, i)) {           \
+                continue;                                  \
+            }                                              \
+            s1 = OP(s1, *((TD *)vs2 + H(i)),               \
+                    &env->fp_status);                      \
+        }                                                  \
+    }                                                      \
+    *((TD *)vd + H(0)) = s1;                               \
+    env->vstart = 0;                                       \
+    /* set tail elements to 1s */                          \
+    vext_set_elems_1s(vd, vta, esz, vlenb);                \
+}
+
 /* Unordered sum */
 GEN_VEXT_FRED(vfredusum_vs_h, uint16_t, uint16_t, H2, H2, float16_add)
-GEN_VEXT_FRED(vfredusum_vs_w, uint32_t, uint32_t, H4, H4, float32_add)
-GEN_VEXT_FRED(vfredusum_vs_d, uint64_t, uint64_t, H8, H8, float64_add)
+GEN_VEXT_FREDUSUM(vfredusum_vs_w, uint32_t, H4, float32_add, float32_sum_n)
+GEN_VEXT_FREDUSUM(vfredusum_vs_d, uint64_t, H8, float64_add, float64_sum_n)
 
 /* Ordered sum */
 GEN_VEXT_FRED(vfredosum_vs_h, uint16_t, uint16_t, H2, H2, float16_add)
@@ -4979,13 +5389,20 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,         \
     target_ulong offset = s1, i_min, i;                                   \
                                                                           \
     i_min = MAX(env->vstart, offset);                                     \
-    for (i = i_min; i < vl; i++) {                                        \
-        if (!vm && !vext_elem_mask(v0, i)) {                              \
-            /* set masked-off elements to 1s */                           \
-            vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);           \
-            continue;                                                     \
+    if (vm && !HOST_BIG_ENDIAN) {                                         \
+        if (i_min < vl) {                                                 \
+            memmove(vd + i_min * esz, vs2 + (i_min - offset) * esz,       \
+                    (vl - i_min) * esz);                                  \
+        }                                                                 \
+    } else {                                                              \
+        for (i = i_min; i < vl; i++) {                                    \
+            if (!vm && !vext_elem_mask(v0, i)) {                          \
+                /* set masked-off elements to 1s */                       \
+                vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);       \
+                continue;                                                 \
+            }                                                             \
+            *((ETYPE *)vd + H(i)) = *((ETYPE *)vs2 + H(i - offset));      \
         }                                                                 \
-        *((ETYPE *)vd + H(i)) = *((ETYPE *)vs2 + H(i - offset));          \
     }                                                                     \
     /* set tail elements to 1s */                                         \
     vext_set_elems_1s(vd, vta, vl * esz, total_elems * esz);              \
@@ -5011,18 +5428,28 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,         \
     target_ulong i_max, i;                                                \
                                                                           \
     i_max = MAX(MIN(s1 < vlmax ? vlmax - s1 : 0, vl), env->vstart);       \
-    for (i = env->vstart; i < i_max; ++i) {                               \
-        if (!vm && !vext_elem_mask(v0, i)) {                              \
-            /* set masked-off elements to 1s */                           \
-            vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);           \
-            continue;                                                     \
+    if (vm && !HOST_BIG_ENDIAN) {                                         \
+        if (i_max > env->vstart) {                                        \
+            memmove(vd + env->vstart * esz, vs2 + (env->vstart + s1) * esz, \
+                    (i_max - env->vstart) * esz);                         \
+        }                                                                 \
+        if (vl > i_max) {                                                 \
+            memset(vd + i_max * esz, 0, (vl - i_max) * esz);              \
+        }                                                                 \
+    } else {                                                              \
+        for (i = env->vstart; i < i_max; ++i) {                           \
+            if (!vm && !vext_elem_mask(v0, i)) {                          \
+                /* set masked-off elements to 1s */                       \
+                vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);       \
+                continue;                                                 \
+            }                                                             \
+            *((ETYPE *)vd + H(i)) = *((ETYPE *)vs2 + H(i + s1));          \
         }                                                                 \
-        *((ETYPE *)vd + H(i)) = *((ETYPE *)vs2 + H(i + s1));              \
-    }                                                                     \
                                                                           \
-    for (i = i_max; i < vl; ++i) {                                        \
-        if (vm || vext_elem_mask(v0, i)) {                                \
-            *((ETYPE *)vd + H(i)) = 0;                                    \
+        for (i = i_max; i < vl; ++i) {                                    \
+            if (vm || vext_elem_mask(v0, i)) {                            \
+                *((ETYPE *)vd + H(i)) = 0;                                \
+            }                                                             \
         }                                                                 \
     }                                                                     \
                                                                           \
@@ -5173,17 +5600,25 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,               \
     uint64_t index;                                                       \
     uint32_t i;                                                           \
                                                                           \
-    for (i = env->vstart; i < vl; i++) {                                  \
-        if (!vm && !vext_elem_mask(v0, i)) {                              \
-            /* set masked-off elements to 1s */                           \
-            vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);           \
-            continue;                                                     \
+    if (vm && sizeof(TS1) == sizeof(TS2) && !HOST_BIG_ENDIAN) {           \
+        if (env->vstart < vl) {                                           \
+            vperm_gather(vd + env->vstart * esz, vs2,                     \
+                         vs1 + env->vstart * esz, esz,                    \
+                         vl - env->vstart, vlmax);                        \
         }                                                                 \
-        index = *((TS1 *)vs1 + HS1(i));                                   \
-        if (index >= vlmax) {                                             \
-            *((TS2 *)vd + HS2(i)) = 0;                                    \
-        } else {                                                          \
-            *((TS2 *)vd + HS2(i)) = *((TS2 *)vs2 + HS2(index));           \
+    } else {                                                              \
+        for (i = env->vstart; i < vl; i++) {                              \
+            if (!vm && !vext_elem_mask(v0, i)) {                          \
+                /* set masked-off elements to 1s */                       \
+                vext_set_elems_1s(vd, vma, i * esz, (i + 1) * esz);       \
+                continue;                                                 \
+            }                                                             \
+            index = *((TS1 *)vs1 + HS1(i));                               \
+            if (index >= vlmax) {                                         \
+                *((TS2 *)vd + HS2(i)) = 0;                                \
+            } else {                                                      \
+                *((TS2 *)vd + HS2(i)) = *((TS2 *)vs2 + HS2(index));       \
+            }                                                             \
         }                                                                 \
     }                                                                     \
     env->vstart = 0;                                                      \
@@ -5250,12 +5685,16 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,               \
     uint32_t vta = vext_vta(desc);                                        \
     uint32_t num = 0, i;                                                  \
                                                                           \
-    for (i = env->vstart; i < vl; i++) {                                  \
-        if (!vext_elem_mask(vs1, i)) {                                    \
-            continue;                                                     \
+    if (env->vstart == 0 && !HOST_BIG_ENDIAN) {                           \
+        vperm_compress(vd, vs2, vs1, esz, vl);                            \
+    } else {                                                              \
+        for (i = env->vstart; i < vl; i++) {                              \
+            if (!vext_elem_mask(vs1, i)) {                                \
+                continue;                                                 \
+            }                                                             \
+            *((ETYPE *)vd + H(num)) = *((ETYPE *)vs2 + H(i));             \
+            num++;                                                        \
         }                                                                 \
-        *((ETYPE *)vd + H(num)) = *((ETYPE *)vs2 + H(i));                 \
-        num++;                                                            \
     }                                                                     \
     env->vstart = 0;                                                      \
     /* set tail elements to 1s */                                         \
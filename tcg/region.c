@@ -60,6 +60,11 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t *size_full; /* per region, its part of agg_size_full */
+    size_t n_free; /* number of evicted regions in @free */
+    size_t *free; /* evicted regions, available for reuse */
+    uint64_t epoch; /* incremented on each region assignment */
+    uint64_t *last_use; /* per region, epoch of last known use */
 };
 
 static struct tcg_region_state region;
@@ -167,10 +172,9 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, or -1 if there is none. */
+static ssize_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -178,20 +182,28 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return -1;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    ssize_t region_idx = tc_ptr_to_region_idx(p);
+
+    if (region_idx < 0) {
+        return NULL;
     }
     return region_trees + region_idx * tree_size;
 }
@@ -331,16 +343,21 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_ptr = start;
     s->code_gen_buffer_size = end - start;
     s->code_gen_highwater = end - TCG_HIGHWATER;
+    region.last_use[curr_region] = ++region.epoch;
 }
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    if (region.current < region.n) {
+        tcg_region_assign(s, region.current);
+        region.current++;
+        return false;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
-    return false;
+    if (region.n_free) {
+        tcg_region_assign(s, region.free[--region.n_free]);
+        return false;
+    }
+    return true;
 }
 
 /*
@@ -352,11 +369,13 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    ssize_t full = tc_ptr_to_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.size_full[full] = size_full - TCG_HIGHWATER;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -388,6 +407,8 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    memset(region.size_full, 0, region.n * sizeof(size_t));
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -398,12 +419,89 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Note that the TB whose code is at @tc_ptr has been executed recently,
+ * making its region a poor candidate for eviction.
+ * Call from a safe-work context.
+ */
+void tcg_region_touch(const void *tc_ptr)
+{
+    ssize_t i = tc_ptr_to_region_idx(tc_ptr);
+
+    if (i >= 0) {
+        region.last_use[i] = region.epoch;
+    }
+}
+
+/* Call from a safe-work context */
+bool tcg_region_has_free(void)
+{
+    return region.current < region.n || region.n_free;
+}
+
+/*
+ * Evict the least recently used region that no context is generating
+ * code into.  @evict_tb is called for each TB of the region and must
+ * remove every reference to it; the region is then made available to
+ * tcg_region_alloc.  Returns false if there is no region to evict.
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(GTraverseFunc evict_tb)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    struct tcg_region_tree *rt;
+    g_autofree bool *busy = g_new0(bool, region.n);
+    ssize_t victim = -1;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+        busy[tc_ptr_to_region_idx(s->code_gen_buffer)] = true;
+    }
+    for (i = 0; i < region.n_free; i++) {
+        busy[region.free[i]] = true;
+    }
+    for (i = 0; i < region.current; i++) {
+        if (!busy[i] &&
+            (victim < 0 || region.last_use[i] < region.last_use[victim])) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+
+    rt = region_trees + victim * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, evict_tb, NULL);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    region.agg_size_full -= region.size_full[victim];
+    region.size_full[victim] = 0;
+    region.free[region.n_free++] = victim;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
+/*
+ * A single context fills the regions one after the other.  Using more
+ * than one region lets tcg_region_evict reclaim code space one region
+ * at a time, rather than flushing the whole buffer.
+ */
+#define TCG_SINGLE_CTX_REGIONS 8
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
+    size_t n_regions = tb_size / (2 * MiB);
+
 #ifdef CONFIG_USER_ONLY
-    return 1;
+    return MAX(1, MIN(n_regions, TCG_SINGLE_CTX_REGIONS));
 #else
-    size_t n_regions;
 
     /*
      * It is likely that some vCPUs will translate more code than others,
@@ -413,14 +511,13 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      */
     /* Use a single region if all we have is one vCPU thread */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        return MAX(1, MIN(n_regions, TCG_SINGLE_CTX_REGIONS));
     }
 
     /*
      * Try to have more regions than max_cpus, with each region being >= 2 MB.
      * If we can't, then just allocate one region per vCPU thread.
      */
-    n_regions = tb_size / (2 * MiB);
     if (n_regions <= max_cpus) {
         return max_cpus;
     }
@@ -710,13 +807,15 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG the single TCG thread uses
+ * the regions one after the other.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
+ * In user-mode all threads share a single context, which uses the regions
+ * one after the other.  Having a region per thread in user-mode is not
+ * supported, because the number of vCPU threads (recall that each thread
  * spawned by the guest corresponds to a vCPU thread) is only bounded by the
  * OS, and usually this number is huge (tens of thousands is not uncommon).
  * Thus, given this large bound on the number of vCPU threads and the fact
@@ -786,6 +885,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.size_full = g_new0(size_t, region.n);
+    region.free = g_new(size_t, region.n);
+    region.last_use = g_new0(uint64_t, region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
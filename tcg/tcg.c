@@ -164,6 +164,7 @@ TCGContext **tcg_ctxs;
 unsigned int tcg_cur_ctxs;
 unsigned int tcg_max_ctxs;
 TCGv_env cpu_env = 0;
+bool tcg_regalloc_tb;
 const void *tcg_code_gen_epilogue;
 uintptr_t tcg_splitwx_diff;
 
@@ -2791,6 +2792,23 @@ static void la_global_sync(TCGContext *s, int ng)
     }
 }
 
+/*
+ * liveness analysis: label whose predecessors may leave globals in
+ * registers: as la_bb_end, except that globals need only be synced.
+ */
+static void la_bb_merge(TCGContext *s, int ng, int nt)
+{
+    int i;
+
+    la_global_sync(s, ng);
+    for (i = ng; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+
+        ts->state = ts->kind == TEMP_LOCAL ? TS_DEAD | TS_MEM : TS_DEAD;
+        la_reset_pref(ts);
+    }
+}
+
 /*
  * liveness analysis: conditional branch: all temps are dead unless
  * explicitly live-across-conditional-branch, globals and local temps
@@ -3132,6 +3150,8 @@ static void liveness_pass_1(TCGContext *s)
                 la_func_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_COND_BRANCH) {
                 la_bb_sync(s, nb_globals, nb_temps);
+            } else if (opc == INDEX_op_set_label && s->regalloc_tb) {
+                la_bb_merge(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_BB_END) {
                 la_bb_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -3569,6 +3589,9 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
 {
     TCGTemp *ts = s->reg_to_temp[reg];
     if (ts != NULL) {
+        if (!ts->mem_coherent && !temp_readonly(ts)) {
+            s->spill_count++;
+        }
         temp_sync(s, ts, allocated_regs, 0, -1);
     }
 }
@@ -3838,6 +3861,64 @@ static void tcg_reg_alloc_cbranch(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Record which globals are in which registers along a forward branch
+ * to @l, keeping only those that agree with every earlier branch to it.
+ */
+static void tcg_reg_alloc_edge(TCGContext *s, TCGLabel *l)
+{
+    TCGTemp **regs = l->edge_regs;
+    int i;
+
+    if (l->has_value) {
+        /* Backward branch: the label already assumed nothing in regs. */
+        return;
+    }
+    if (regs == NULL) {
+        regs = tcg_malloc(sizeof(TCGTemp *) * TCG_TARGET_NB_REGS);
+        for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+            TCGTemp *ts = s->reg_to_temp[i];
+            regs[i] = ts && ts->kind == TEMP_GLOBAL ? ts : NULL;
+        }
+        l->edge_regs = regs;
+    } else {
+        for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
+            if (regs[i] != s->reg_to_temp[i]) {
+                regs[i] = NULL;
+            }
+        }
+    }
+    l->nb_edges++;
+}
+
+/*
+ * At a label, keep the globals that are in the same register on the
+ * fall-through path and on every branch to the label.  The label may
+ * also be reached by a backward or unconditional branch, which expect
+ * all globals in memory: then nb_edges does not account for all refs.
+ * Other temps are handled by the liveness analysis as for bb_end.
+ */
+static void tcg_reg_alloc_label(TCGContext *s, TCGLabel *l)
+{
+    bool merge = l->nb_edges == l->refs;
+    int i;
+
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (ts->kind == TEMP_FIXED || ts->val_type == TEMP_VAL_MEM) {
+            continue;
+        }
+        /* The liveness analysis ensures that globals are synced. */
+        tcg_debug_assert(ts->val_type != TEMP_VAL_REG || ts->mem_coherent);
+        if (ts->val_type == TEMP_VAL_REG && merge
+            && (l->edge_regs == NULL || l->edge_regs[ts->reg] == ts)) {
+            continue;
+        }
+        temp_free_or_dead(s, ts, 1);
+    }
+}
+
 /*
  * Specialized code generation for INDEX_op_mov_* with a constant.
  */
@@ -4299,6 +4380,11 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
 
     if (def->flags & TCG_OPF_COND_BRANCH) {
         tcg_reg_alloc_cbranch(s, i_allocated_regs);
+        if (s->regalloc_tb) {
+            /* The label is the last constant argument. */
+            i = nb_oargs + nb_iargs + def->nb_cargs - 1;
+            tcg_reg_alloc_edge(s, arg_label(op->args[i]));
+        }
     } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
     } else {
@@ -4862,7 +4948,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, target_ulong pc_start)
 #endif
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    tcg_optimize(s);
+    /* Cold TBs are translated quickly, and optimized once they are hot. */
+    if (tb->tier_count <= 0) {
+        tcg_optimize(s);
+    }
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -4870,6 +4959,12 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, target_ulong pc_start)
     qatomic_set(&prof->la_time, prof->la_time - profile_getclock());
 #endif
 
+    /*
+     * Indirect globals are lowered to temps that liveness_pass_2 reloads
+     * at every label, so only keep direct globals in registers.
+     */
+    s->regalloc_tb = tcg_regalloc_tb && s->nb_indirects == 0;
+
     reachable_code_pass(s);
     liveness_pass_1(s);
 
@@ -4917,6 +5012,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, target_ulong pc_start)
     tb->jmp_insn_offset[1] = TB_JMP_OFFSET_INVALID;
 
     tcg_reg_alloc_start(s);
+    s->spill_count = 0;
 
     /*
      * Reset the buffer pointers when restarting after overflow.
@@ -4972,7 +5068,11 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, target_ulong pc_start)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            if (s->regalloc_tb) {
+                tcg_reg_alloc_label(s, arg_label(op->args[0]));
+            } else {
+                tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            }
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
@@ -0,0 +1,282 @@
+/*
+ * Vector element permutation benchmark
+ *
+ * Checks each implementation of the vperm functions, as selected in
+ * turn by test_vperm_next_accel, against a scalar reference on random
+ * register group configurations (VLEN, SEW, LMUL, number of fields and
+ * vl), then measures their throughput on the largest register groups.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/vperm.h"
+
+/* VLEN = 1024 bits and LMUL = 8 */
+#define MAX_GROUP 1024
+
+static uint8_t src[8 * MAX_GROUP];
+static uint8_t idx[MAX_GROUP];
+static uint64_t mask[MAX_GROUP / 64];
+static uint8_t dst[8 * MAX_GROUP];
+static uint8_t ref[8 * MAX_GROUP];
+
+static unsigned int n_configs = 10000;
+static unsigned int n_iterations = 20000;
+static uint64_t seed = 1;
+
+static const char commands_string[] =
+    " -c = number of random configurations to check\n"
+    " -i = number of iterations of each benchmark\n"
+    " -s = seed for the random configurations";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/* From: https://en.wikipedia.org/wiki/Xorshift */
+static uint64_t rnd(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * UINT64_C(2685821657736338717);
+}
+
+static void fill(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    while (len--) {
+        *p++ = rnd();
+    }
+}
+
+static uint64_t ld_elem(const void *p, unsigned esz)
+{
+    switch (esz) {
+    case 1:
+        return ldub_p(p);
+    case 2:
+        return lduw_he_p(p);
+    case 4:
+        return (uint32_t)ldl_he_p(p);
+    default:
+        return ldq_he_p(p);
+    }
+}
+
+/* The scalar references, one element at a time. */
+
+static void ref_deinterleave(void *d, size_t stride, const void *s,
+                             unsigned nf, unsigned esz, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (unsigned k = 0; k < nf; k++) {
+            memcpy(d + k * stride + i * esz, s + (i * nf + k) * esz, esz);
+        }
+    }
+}
+
+static void ref_interleave(void *d, const void *s, size_t stride,
+                           unsigned nf, unsigned esz, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (unsigned k = 0; k < nf; k++) {
+            memcpy(d + (i * nf + k) * esz, s + k * stride + i * esz, esz);
+        }
+    }
+}
+
+static void ref_gather(void *d, const void *s, const void *x,
+                       unsigned esz, size_t n, uint64_t limit)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t index = ld_elem(x + i * esz, esz);
+
+        if (index < limit) {
+            memcpy(d + i * esz, s + index * esz, esz);
+        } else {
+            memset(d + i * esz, 0, esz);
+        }
+    }
+}
+
+static size_t ref_compress(void *d, const void *s, const uint64_t *m,
+                           unsigned esz, size_t n)
+{
+    size_t k = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (m[i / 64] & (1ull << (i % 64))) {
+            memcpy(d + k++ * esz, s + i * esz, esz);
+        }
+    }
+    return k;
+}
+
+/* A random index, mostly in range, sometimes with the sign bit set. */
+static uint64_t rnd_index(size_t vlmax)
+{
+    uint64_t r = rnd();
+
+    switch (r % 8) {
+    case 0:
+        return r >> 3;
+    case 1:
+        return vlmax + (r >> 3) % 4;
+    default:
+        return (r >> 3) % vlmax;
+    }
+}
+
+static void fill_idx(unsigned esz, size_t n, size_t vlmax)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t v = rnd_index(vlmax);
+
+        memcpy(idx + i * esz, &v, esz);
+    }
+}
+
+static void check_one(void)
+{
+    static const unsigned vlens[] = { 128, 256, 512, 1024 };
+    unsigned vlenb = vlens[rnd() % ARRAY_SIZE(vlens)] / 8;
+    unsigned esz = 1 << (rnd() % 4);
+    unsigned lmul = 1 << (rnd() % 4);
+    unsigned nf = MIN(2 + rnd() % 7, 8 / lmul);
+    size_t group = vlenb * lmul;
+    size_t vlmax = group / esz;
+    size_t vl = rnd() % (vlmax + 1);
+    size_t k, kref;
+
+    fill(src, sizeof(src));
+    fill(dst, sizeof(dst));
+    memcpy(ref, dst, sizeof(dst));
+    vperm_deinterleave(dst, group, src, nf, esz, vl);
+    ref_deinterleave(ref, group, src, nf, esz, vl);
+    g_assert(memcmp(dst, ref, sizeof(dst)) == 0);
+
+    fill(dst, sizeof(dst));
+    memcpy(ref, dst, sizeof(dst));
+    vperm_interleave(dst, src, group, nf, esz, vl);
+    ref_interleave(ref, src, group, nf, esz, vl);
+    g_assert(memcmp(dst, ref, sizeof(dst)) == 0);
+
+    fill_idx(esz, vl, vlmax);
+    fill(dst, sizeof(dst));
+    memcpy(ref, dst, sizeof(dst));
+    vperm_gather(dst, src, idx, esz, vl, vlmax);
+    ref_gather(ref, src, idx, esz, vl, vlmax);
+    g_assert(memcmp(dst, ref, sizeof(dst)) == 0);
+
+    fill(mask, sizeof(mask));
+    if (rnd() % 2) {
+        /* sparse masks too */
+        for (size_t i = 0; i < ARRAY_SIZE(mask); i++) {
+            mask[i] &= rnd() & rnd();
+        }
+    }
+    fill(dst, sizeof(dst));
+    memcpy(ref, dst, sizeof(dst));
+    k = vperm_compress(dst, src, mask, esz, vl);
+    kref = ref_compress(ref, src, mask, esz, vl);
+    g_assert(k == kref);
+    g_assert(memcmp(dst, ref, sizeof(dst)) == 0);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *op, unsigned esz, unsigned nf, size_t n,
+                   double t)
+{
+    printf("  %-12s e%-2u nf=%u: %10.1f Melem/s\n",
+           op, esz * 8, nf, (double)n * n_iterations / t / 1e6);
+}
+
+static void bench(void)
+{
+    for (unsigned esz = 1; esz <= 8; esz *= 2) {
+        size_t n = MAX_GROUP / esz;
+        double t;
+
+        for (unsigned nf = 2; nf <= 8; nf *= 2) {
+            size_t fn = n / nf;
+
+            t = now();
+            for (unsigned i = 0; i < n_iterations; i++) {
+                vperm_deinterleave(dst, MAX_GROUP, src, nf, esz, fn);
+            }
+            report("deinterleave", esz, nf, fn * nf, now() - t);
+
+            t = now();
+            for (unsigned i = 0; i < n_iterations; i++) {
+                vperm_interleave(dst, src, MAX_GROUP, nf, esz, fn);
+            }
+            report("interleave", esz, nf, fn * nf, now() - t);
+        }
+
+        fill_idx(esz, n, n);
+        t = now();
+        for (unsigned i = 0; i < n_iterations; i++) {
+            vperm_gather(dst, src, idx, esz, n, n);
+        }
+        report("gather", esz, 1, n, now() - t);
+
+        fill(mask, sizeof(mask));
+        t = now();
+        for (unsigned i = 0; i < n_iterations; i++) {
+            vperm_compress(dst, src, mask, esz, n);
+        }
+        report("compress", esz, 1, n, now() - t);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned accel = 0;
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hc:i:s:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            return 0;
+        case 'c':
+            n_configs = atoi(optarg);
+            break;
+        case 'i':
+            n_iterations = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        default:
+            usage_complete(argv);
+            return 1;
+        }
+    }
+
+    do {
+        printf("implementation %u:\n", accel++);
+        for (unsigned i = 0; i < n_configs; i++) {
+            check_one();
+        }
+        printf("  %u configurations checked\n", n_configs);
+        bench();
+    } while (test_vperm_next_accel());
+    return 0;
+}
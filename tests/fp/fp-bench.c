@@ -34,6 +34,8 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_TO_INT,
+    OP_FROM_INT,
     OP_MAX_NR,
 };
 
@@ -45,6 +47,8 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_TO_INT] = "toInt",
+    [OP_FROM_INT] = "fromInt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -52,9 +56,11 @@ enum precision {
     PREC_SINGLE,
     PREC_DOUBLE,
     PREC_QUAD,
+    PREC_HALF,
     PREC_FLOAT32,
     PREC_FLOAT64,
     PREC_FLOAT128,
+    PREC_FLOAT16,
     PREC_MAX_NR,
 };
 
@@ -90,10 +96,12 @@ static const char * const tester_names[] = {
 union fp {
     float f;
     double d;
+    float16 f16;
     float32 f32;
     float64 f64;
     float128 f128;
     uint64_t u64;
+    int32_t i32;
 };
 
 struct op_state;
@@ -151,6 +159,16 @@ static void update_random_ops(int n_ops, enum precision prec)
     for (i = 0; i < n_ops; i++) {
 
         switch (prec) {
+        case PREC_HALF:
+        case PREC_FLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!float16_is_normal(r));
+            random_ops[i] = r;
+            break;
+        }
         case PREC_SINGLE:
         case PREC_FLOAT32:
         {
@@ -191,13 +209,63 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * Conversions to integer take operands with an exponent in [0, 31), so
+ * that they are mostly in range; conversions from integer take int32_t
+ * operands of all magnitudes.
+ */
+static void fill_int_range(union fp *op, enum precision prec)
+{
+    uint64_t e;
+
+    switch (prec) {
+    case PREC_HALF:
+    case PREC_FLOAT16:
+        e = 15 + float16_val(op->f16) % 16;
+        op->f16 = make_float16((float16_val(op->f16) & 0x83ff) | e << 10);
+        break;
+    case PREC_SINGLE:
+    case PREC_FLOAT32:
+        e = 127 + float32_val(op->f32) % 31;
+        op->f32 = make_float32((float32_val(op->f32) & 0x807fffff) | e << 23);
+        break;
+    case PREC_DOUBLE:
+    case PREC_FLOAT64:
+        e = 1023 + float64_val(op->f64) % 31;
+        op->f64 = make_float64((float64_val(op->f64) & 0x800fffffffffffffULL) |
+                               e << 52);
+        break;
+    case PREC_QUAD:
+    case PREC_FLOAT128:
+        e = 16383 + op->f128.low % 31;
+        op->f128.high = (op->f128.high & 0x8000ffffffffffffULL) | e << 48;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        enum op op, bool no_neg)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
+        if (op == OP_FROM_INT) {
+            uint64_t r = prec == PREC_QUAD || prec == PREC_FLOAT128 ?
+                         random_quad_ops[i].low : random_ops[i];
+
+            ops[i].i32 = (int32_t)r >> (r >> 32) % 32;
+            continue;
+        }
         switch (prec) {
+        case PREC_HALF:
+        case PREC_FLOAT16:
+            ops[i].f16 = make_float16(random_ops[i]);
+            if (no_neg && float16_is_neg(ops[i].f16)) {
+                ops[i].f16 = float16_chs(ops[i].f16);
+            }
+            break;
         case PREC_SINGLE:
         case PREC_FLOAT32:
             ops[i].f32 = make_float32(random_ops[i]);
@@ -222,6 +290,9 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
         default:
             g_assert_not_reached();
         }
+        if (op == OP_TO_INT) {
+            fill_int_range(&ops[i], prec);
+        }
     }
 }
 
@@ -241,7 +312,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +341,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_FROM_INT:
+                    res.f = ops[0].i32;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,13 +382,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_TO_INT:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_FROM_INT:
+                    res.d = ops[0].i32;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -340,13 +423,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f32 = int32_to_float32(ops[0].i32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -375,13 +464,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f64 = int32_to_float64(ops[0].i32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, op, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
@@ -410,6 +505,53 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_TO_INT:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f128 = int32_to_float128(ops[0].i32, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_FLOAT16:
+            fill_random(ops, n_ops, prec, op, no_neg);
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float16 a = ops[0].f16;
+                float16 b = ops[1].f16;
+                float16 c = ops[2].f16;
+
+                switch (op) {
+                case OP_ADD:
+                    res.f16 = float16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.f16 = float16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.f16 = float16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.f16 = float16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.f16 = float16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.f16 = float16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = float16_compare_quiet(a, b, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.u64 = float16_to_int64(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f16 = int32_to_float16(ops[0].i32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -440,7 +582,8 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
     GEN_BENCH(bench_ ## opname ## _double, double, PREC_DOUBLE, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float32, float32, PREC_FLOAT32, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float64, float64, PREC_FLOAT64, op, n_ops) \
-    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops)
+    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _float16, float16, PREC_FLOAT16, op, n_ops)
 
 GEN_BENCH_ALL_TYPES(add, OP_ADD, 2)
 GEN_BENCH_ALL_TYPES(sub, OP_SUB, 2)
@@ -448,6 +591,8 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(to_int, OP_TO_INT, 1)
+GEN_BENCH_ALL_TYPES(from_int, OP_FROM_INT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -455,7 +600,8 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
     GEN_BENCH_NO_NEG(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n) \
-    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n)
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float16, float16, PREC_FLOAT16, op, n)
 
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
@@ -470,6 +616,7 @@ GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
         [PREC_FLOAT32]   = bench_ ## opname ## _float32,        \
         [PREC_FLOAT64]   = bench_ ## opname ## _float64,        \
         [PREC_FLOAT128]   = bench_ ## opname ## _float128,      \
+        [PREC_FLOAT16]   = bench_ ## opname ## _float16,        \
     }
 
 static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
@@ -480,6 +627,8 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(to_int, OP_TO_INT),
+    GEN_BENCH_FUNCS(from_int, OP_FROM_INT),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -518,8 +667,8 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
-    fprintf(stderr, " -p = floating point precision (single, double, quad[soft only]). "
-            "Default: single\n");
+    fprintf(stderr, " -p = floating point precision (single, double, "
+            "quad[soft only], half[soft only]). Default: single\n");
     fprintf(stderr, " -r = rounding mode (even, zero, down, up, tieaway). "
             "Default: even\n");
     fprintf(stderr, " -t = tester (%s). Default: %s\n",
@@ -641,6 +790,8 @@ static void parse_args(int argc, char *argv[])
                 precision = PREC_DOUBLE;
             } else if (!strcmp(optarg, "quad")) {
                 precision = PREC_QUAD;
+            } else if (!strcmp(optarg, "half")) {
+                precision = PREC_HALF;
             } else {
                 fprintf(stderr, "Unsupported precision '%s'\n", optarg);
                 exit(EXIT_FAILURE);
@@ -687,6 +838,9 @@ static void parse_args(int argc, char *argv[])
         case PREC_QUAD:
             precision = PREC_FLOAT128;
             break;
+        case PREC_HALF:
+            precision = PREC_FLOAT16;
+            break;
         default:
             g_assert_not_reached();
         }
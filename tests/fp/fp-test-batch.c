@@ -0,0 +1,370 @@
+/*
+ * fp-test-batch.c - test QEMU's softfloat batch operations
+ *
+ * The batch functions promise the results and flags of the scalar
+ * functions applied to each element in turn; check them against the
+ * scalar loop on random batches.  The batches are mostly clean, so that
+ * whole chunks take the host FPU path, with special values mixed in to
+ * push chunks back to softfloat.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef HW_POISON_H
+#error Must define HW_POISON_H to work around TARGET_* poisoning
+#endif
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "fpu/softfloat.h"
+
+/* Several chunks of 16 elements and a partial one */
+#define MAX_N 70
+#define ITERATIONS 20000
+
+typedef enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_MULADD,
+} BatchOp;
+
+static const char * const op_names[] = { "add", "sub", "mul", "muladd" };
+
+static const int muladd_flags[] = {
+    0,
+    float_muladd_negate_c,
+    float_muladd_negate_product,
+    float_muladd_negate_result,
+    float_muladd_negate_c | float_muladd_negate_product,
+    float_muladd_halve_result,
+};
+
+static uint64_t rng_state = 88172645463325252ull;
+static int errors;
+
+static uint64_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+typedef struct {
+    int mant_bits;
+    int exp_bits;
+} FloatFormat;
+
+static const FloatFormat fmt32 = { 23, 8 };
+static const FloatFormat fmt64 = { 52, 11 };
+
+static uint64_t make_bits(const FloatFormat *f, uint64_t sign, uint64_t exp,
+                          uint64_t mant)
+{
+    return sign << (f->mant_bits + f->exp_bits) | exp << f->mant_bits |
+        (mant & ((1ull << f->mant_bits) - 1));
+}
+
+/* Normal numbers with moderate exponents: nothing overflows or underflows */
+static uint64_t rand_moderate(const FloatFormat *f)
+{
+    uint64_t bias = (1ull << (f->exp_bits - 1)) - 1;
+
+    return make_bits(f, rnd() & 1, bias - 8 + rnd() % 16, rnd());
+}
+
+/*
+ * Normal numbers close to the limits of the range: their sums or
+ * products underflow or overflow.
+ */
+static uint64_t rand_limit(const FloatFormat *f)
+{
+    uint64_t bias = (1ull << (f->exp_bits - 1)) - 1;
+    uint64_t max_exp = 2 * bias;
+    uint64_t exp;
+
+    switch (rnd() % 6) {
+    case 0:
+        exp = 1 + rnd() % 3;                    /* near FLT_MIN */
+        break;
+    case 1:
+        exp = bias / 2 + rnd() % 4;             /* products underflow */
+        break;
+    case 2:
+        exp = bias + bias / 2 + rnd() % 4;      /* products overflow */
+        break;
+    case 3:
+        exp = max_exp - rnd() % 2;              /* near FLT_MAX */
+        break;
+    case 4:
+        return make_bits(f, rnd() & 1, 1, 0);   /* FLT_MIN */
+    default:
+        return make_bits(f, rnd() & 1, max_exp, -1); /* FLT_MAX */
+    }
+    return make_bits(f, rnd() & 1, exp, rnd());
+}
+
+/* Anything that is neither a zero nor a normal number */
+static uint64_t rand_special(const FloatFormat *f)
+{
+    uint64_t max_exp = (1ull << f->exp_bits) - 1;
+    uint64_t quiet = 1ull << (f->mant_bits - 1);
+
+    switch (rnd() % 4) {
+    case 0:
+        return make_bits(f, rnd() & 1, 0, rnd() | 1);           /* denormal */
+    case 1:
+        return make_bits(f, rnd() & 1, max_exp, 0);             /* infinity */
+    case 2:
+        return make_bits(f, rnd() & 1, max_exp, rnd() | quiet); /* qNaN */
+    default:
+        return make_bits(f, rnd() & 1, max_exp,
+                         (rnd() & ~quiet) | 1);                 /* sNaN */
+    }
+}
+
+static uint64_t rand_elem(const FloatFormat *f, int mode)
+{
+    switch (mode) {
+    case 0:
+        /* clean: whole chunks go through the host FPU */
+        return rnd() % 8 ? rand_moderate(f) : make_bits(f, rnd() & 1, 0, 0);
+    case 1:
+        /* a few special elements spoil some of the chunks */
+        return rnd() % 32 ? rand_moderate(f) : rand_special(f);
+    case 2:
+        return rnd() % 2 ? rand_limit(f) : rand_moderate(f);
+    default:
+        return rnd() % 2 ? rand_special(f) : rnd();
+    }
+}
+
+static void rand_status(float_status *s)
+{
+    static const FloatRoundMode modes[] = {
+        float_round_nearest_even, float_round_nearest_even,
+        float_round_nearest_even, float_round_to_zero, float_round_up,
+    };
+
+    memset(s, 0, sizeof(*s));
+    set_float_rounding_mode(modes[rnd() % ARRAY_SIZE(modes)], s);
+    /* The host FPU is only used once inexact has been raised. */
+    set_float_exception_flags(rnd() % 4 ? float_flag_inexact : 0, s);
+    set_flush_to_zero(rnd() % 4 == 0, s);
+    set_flush_inputs_to_zero(rnd() % 8 == 0, s);
+    set_default_nan_mode(rnd() % 2, s);
+    set_float_detect_tininess(rnd() % 2, s);
+}
+
+static void report(const char *what, size_t n, size_t i, uint64_t got,
+                   uint64_t expected, int got_flags, int expected_flags)
+{
+    printf("%s, %zu elements: element %zu %016" PRIx64 " flags %02x,"
+           " expected %016" PRIx64 " flags %02x\n", what, n, i,
+           got, got_flags, expected, expected_flags);
+    if (++errors == 20) {
+        exit(1);
+    }
+}
+
+/*
+ * Run one random batch through T##_<op>_n, with @d aliasing one of the
+ * inputs if asked, and compare with the scalar loop.
+ */
+#define GEN_TEST_BATCH(T, FMT)                                              \
+static void test_##T##_batch(void)                                         \
+{                                                                          \
+    T a[MAX_N], b[MAX_N], c[MAX_N], in[3][MAX_N], out[MAX_N], ref[MAX_N];  \
+    size_t n = rnd() % MAX_N, i;                                           \
+    int mode = rnd() % 4;                                                  \
+    BatchOp op = rnd() % 4;                                                \
+    bool b_scalar = rnd() % 2;                                             \
+    int flags = muladd_flags[rnd() % ARRAY_SIZE(muladd_flags)];            \
+    float_status sr, sb;                                                   \
+    char what[64];                                                         \
+    T *d;                                                                  \
+                                                                           \
+    for (i = 0; i < MAX_N; i++) {                                          \
+        a[i] = make_##T(rand_elem(&FMT, mode));                            \
+        b[i] = make_##T(rand_elem(&FMT, mode));                            \
+        c[i] = make_##T(rand_elem(&FMT, mode));                            \
+    }                                                                      \
+    rand_status(&sr);                                                      \
+    sb = sr;                                                               \
+                                                                           \
+    for (i = 0; i < n; i++) {                                              \
+        T bi = b[b_scalar ? 0 : i];                                        \
+                                                                           \
+        switch (op) {                                                      \
+        case OP_ADD:                                                       \
+            ref[i] = T##_add(a[i], bi, &sr);                               \
+            break;                                                         \
+        case OP_SUB:                                                       \
+            ref[i] = T##_sub(a[i], bi, &sr);                               \
+            break;                                                         \
+        case OP_MUL:                                                       \
+            ref[i] = T##_mul(a[i], bi, &sr);                               \
+            break;                                                         \
+        default:                                                           \
+            ref[i] = T##_muladd(a[i], bi, c[i], flags, &sr);               \
+            break;                                                         \
+        }                                                                  \
+    }                                                                      \
+                                                                           \
+    /* @d may alias any input, but not a scalar @b. */                    \
+    memcpy(in[0], a, sizeof(a));                                           \
+    memcpy(in[1], b, sizeof(b));                                           \
+    memcpy(in[2], c, sizeof(c));                                           \
+    switch (rnd() % 4) {                                                   \
+    case 1:                                                                \
+        d = in[0];                                                         \
+        break;                                                             \
+    case 2:                                                                \
+        d = b_scalar ? out : in[1];                                        \
+        break;                                                             \
+    case 3:                                                                \
+        d = op == OP_MULADD ? in[2] : out;                                 \
+        break;                                                             \
+    default:                                                               \
+        d = out;                                                           \
+        break;                                                             \
+    }                                                                      \
+    switch (op) {                                                          \
+    case OP_ADD:                                                           \
+        T##_add_n(d, in[0], in[1], b_scalar, n, &sb);                      \
+        break;                                                             \
+    case OP_SUB:                                                           \
+        T##_sub_n(d, in[0], in[1], b_scalar, n, &sb);                      \
+        break;                                                             \
+    case OP_MUL:                                                           \
+        T##_mul_n(d, in[0], in[1], b_scalar, n, &sb);                      \
+        break;                                                             \
+    default:                                                               \
+        T##_muladd_n(d, in[0], in[1], b_scalar, in[2], flags, n, &sb);     \
+        break;                                                             \
+    }                                                                      \
+                                                                           \
+    snprintf(what, sizeof(what), #T "_%s_n%s, mode %d, flags %x",          \
+             op_names[op], b_scalar ? " (scalar b)" : "", mode, flags);    \
+    for (i = 0; i < n; i++) {                                              \
+        if (T##_val(d[i]) != T##_val(ref[i])) {                            \
+            report(what, n, i, T##_val(d[i]), T##_val(ref[i]),             \
+                   sb.float_exception_flags, sr.float_exception_flags);    \
+            return;                                                        \
+        }                                                                  \
+    }                                                                      \
+    if (sb.float_exception_flags != sr.float_exception_flags) {            \
+        report(what, n, n, 0, 0,                                           \
+               sb.float_exception_flags, sr.float_exception_flags);        \
+    }                                                                      \
+}
+
+GEN_TEST_BATCH(float32, fmt32)
+GEN_TEST_BATCH(float64, fmt64)
+
+/*
+ * The sums may add in any order.  Sums of multiples of 1/8 that fit in
+ * the significand are exact whatever the order, sums of two or more
+ * numbers of one sign in the top binade overflow whatever the order, and
+ * sums that meet a special element, or run with flush_to_zero, are done
+ * in order: those must match the ordered scalar sum.  Other sums of
+ * moderate numbers must have the flags of the ordered sum, and a value
+ * within the error bound of a sum in any order.
+ */
+#define GEN_TEST_SUM(T, FMT, HOST, EPS)                                    \
+static void test_##T##_sum(void)                                           \
+{                                                                          \
+    T a[MAX_N], acc, ref, res;                                             \
+    size_t n = 2 + rnd() % (MAX_N - 2), i;                                 \
+    int mode = rnd() % 4;                                                  \
+    int range = rnd() % 8 ? 20001 : 1;                                     \
+    uint64_t sign = rnd() & 1;                                             \
+    uint64_t max_exp = (1ull << FMT.exp_bits) - 2;                         \
+    float_status sr, sb, sg = { };                                         \
+    long double exact = 0, bound = 0;                                      \
+    char what[64];                                                         \
+                                                                           \
+    for (i = 0; i < n; i++) {                                              \
+        switch (mode) {                                                    \
+        case 0:                                                            \
+            /* all zeros of one sign when range is 1 */                    \
+            a[i] = int64_to_##T((int64_t)(rnd() % range) - range / 2,      \
+                                &sg);                                      \
+            a[i] = T##_scalbn(a[i], -3, &sg);                              \
+            a[i] = sign ? T##_chs(a[i]) : a[i];                            \
+            break;                                                         \
+        case 3:                                                            \
+            a[i] = make_##T(make_bits(&FMT, sign, max_exp, rnd()));        \
+            break;                                                         \
+        default:                                                           \
+            a[i] = make_##T(rand_moderate(&FMT));                          \
+            break;                                                         \
+        }                                                                  \
+    }                                                                      \
+    if (mode == 2) {                                                       \
+        a[rnd() % n] = make_##T(rand_special(&FMT));                       \
+    }                                                                      \
+    if (mode == 0) {                                                       \
+        acc = sign ? T##_chs(T##_zero) : T##_zero;                         \
+    } else if (mode == 3 && rnd() % 2) {                                   \
+        acc = make_##T(make_bits(&FMT, sign, max_exp, rnd()));             \
+    } else {                                                               \
+        acc = make_##T(rand_moderate(&FMT));                               \
+    }                                                                      \
+                                                                           \
+    rand_status(&sr);                                                      \
+    if (mode == 1 && rnd() % 2) {                                          \
+        set_flush_to_zero(false, &sr);                                     \
+    }                                                                      \
+    sb = sr;                                                               \
+    ref = acc;                                                             \
+    for (i = 0; i < n; i++) {                                              \
+        ref = T##_add(ref, a[i], &sr);                                     \
+    }                                                                      \
+    res = T##_sum_n(acc, a, n, &sb);                                       \
+                                                                           \
+    snprintf(what, sizeof(what), #T "_sum_n, mode %d", mode);              \
+    if (sb.float_exception_flags != sr.float_exception_flags) {            \
+        report(what, n, n, T##_val(res), T##_val(ref),                     \
+               sb.float_exception_flags, sr.float_exception_flags);        \
+        return;                                                            \
+    }                                                                      \
+    if (T##_val(res) == T##_val(ref)) {                                    \
+        return;                                                            \
+    }                                                                      \
+    if (mode == 1 && !sr.flush_to_zero) {                                  \
+        union { T s; HOST h; } u;                                          \
+                                                                           \
+        u.s = acc;                                                         \
+        exact = u.h;                                                       \
+        bound = fabsl(exact);                                              \
+        for (i = 0; i < n; i++) {                                          \
+            u.s = a[i];                                                    \
+            exact += u.h;                                                  \
+            bound += fabsl((long double)u.h);                              \
+        }                                                                  \
+        u.s = res;                                                         \
+        if (fabsl(u.h - exact) <= 2 * (n + 1) * EPS * bound) {             \
+            return;                                                        \
+        }                                                                  \
+    }                                                                      \
+    report(what, n, n, T##_val(res), T##_val(ref),                         \
+           sb.float_exception_flags, sr.float_exception_flags);            \
+}
+
+GEN_TEST_SUM(float32, fmt32, float, FLT_EPSILON)
+GEN_TEST_SUM(float64, fmt64, double, DBL_EPSILON)
+
+int main(int ac, char **av)
+{
+    int i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        test_float32_batch();
+        test_float64_batch();
+        test_float32_sum();
+        test_float64_sum();
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Floating point kernel throughput
+ *
+ * Runs small kernels shaped like the inner loops of FP heavy programs
+ * (axpy, dot product, stencil, matrix multiply, n-body distances,
+ * binning through integer conversions, half precision axpy) and
+ * reports the emulated MFLOPS of each.  The conversion kernel runs in
+ * every rounding mode, since the guest may change frm at any time.
+ *
+ * Usage: fp-kernels-bench [iterations]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <assert.h>
+#include <fenv.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define N 4096
+#define M 32
+
+static unsigned long iterations = 50;
+static double x[N], y[N], z[N];
+static float a[M * M], b[M * M], c[M * M];
+static uint16_t hx[N], hy[N];
+static unsigned int hist[64];
+static volatile double sink;
+
+static void axpy(double s)
+{
+    for (int i = 0; i < N; i++) {
+        y[i] = s * x[i] + y[i];
+    }
+}
+
+static double dot(void)
+{
+    double acc = 0;
+
+    for (int i = 0; i < N; i++) {
+        acc += x[i] * y[i];
+    }
+    return acc;
+}
+
+static void stencil(void)
+{
+    for (int i = 1; i < N - 1; i++) {
+        z[i] = 0.25 * (y[i - 1] + 2 * y[i] + y[i + 1]);
+    }
+}
+
+static void matmul(void)
+{
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < M; j++) {
+            float acc = 0;
+
+            for (int k = 0; k < M; k++) {
+                acc += a[i * M + k] * b[k * M + j];
+            }
+            c[i * M + j] = acc;
+        }
+    }
+}
+
+static double nbody(void)
+{
+    double e = 0;
+
+    for (int i = 0; i < N - 2; i++) {
+        double dx = x[i] - x[i + 1];
+        double dy = y[i] - y[i + 1];
+        double dz = z[i] - z[i + 1];
+
+        e += 1.0 / sqrt(dx * dx + dy * dy + dz * dz + 1.0);
+    }
+    return e;
+}
+
+static void binning(void)
+{
+    for (int i = 0; i < N; i++) {
+        hist[(unsigned int)(long)rint(x[i] * 63.0) & 63]++;
+    }
+}
+
+/* y = s * x + y in binary16, with separate multiply and add. */
+static void haxpy(uint16_t s)
+{
+    for (int i = 0; i < N; i++) {
+        uint16_t r;
+
+        asm("fmv.h.x ft0, %1\n"
+            "fmv.h.x ft1, %2\n"
+            "fmv.h.x ft2, %3\n"
+            "fmul.h ft0, ft0, ft1\n"
+            "fadd.h ft0, ft0, ft2\n"
+            "fmv.x.h %0, ft0"
+            : "=r"(r) : "r"(s), "r"(hx[i]), "r"(hy[i]) : "ft0", "ft1", "ft2");
+        hy[i] = r;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double flops, double t)
+{
+    printf("%-16s %10.1f MFLOPS\n", name, flops * iterations / t / 1e6);
+}
+
+#define RUN(name, flops, body)                                  \
+    do {                                                        \
+        double t = now();                                       \
+        for (unsigned long it = 0; it < iterations; it++) {     \
+            body;                                               \
+        }                                                       \
+        report(name, flops, now() - t);                         \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int mode;
+    } modes[] = {
+        { "binning rne", FE_TONEAREST },
+        { "binning rtz", FE_TOWARDZERO },
+        { "binning rdn", FE_DOWNWARD },
+        { "binning rup", FE_UPWARD },
+    };
+    unsigned int total = 0;
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    for (int i = 0; i < N; i++) {
+        x[i] = (i % 997) / 997.0;
+        y[i] = (i % 499) / 499.0;
+        z[i] = (i % 251) / 251.0;
+        /* 1 + i / 4096, and 0.5 */
+        hx[i] = 0x3c00 | ((i & 0xfff) >> 2);
+        hy[i] = 0x3800;
+    }
+    for (int i = 0; i < M * M; i++) {
+        a[i] = (i % 13) * 0.125f;
+        b[i] = (i % 7) * 0.25f;
+    }
+
+    RUN("axpy", 2.0 * N, axpy(1e-3));
+    RUN("dot", 2.0 * N, sink = dot());
+    RUN("stencil", 4.0 * N, stencil());
+    RUN("matmul", 2.0 * M * M * M, matmul());
+    RUN("nbody", 12.0 * (N - 2), sink = nbody());
+    for (int i = 0; i < 4; i++) {
+        fesetround(modes[i].mode);
+        RUN(modes[i].name, 2.0 * N, binning());
+    }
+    fesetround(FE_TONEAREST);
+    /* 2^-10: y stays well within the binary16 range */
+    RUN("haxpy", 2.0 * N, haxpy(0x1400));
+
+    for (int i = 0; i < 64; i++) {
+        total += hist[i];
+    }
+    assert(total == 4 * N * iterations);
+    /* the products and sums of matmul are all exact */
+    for (int i = 0; i < M * M; i++) {
+        double acc = 0;
+
+        for (int k = 0; k < M; k++) {
+            acc += (double)a[i / M * M + k] * b[k * M + i % M];
+        }
+        assert(c[i] == acc);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Concurrent code modification benchmark
+ *
+ * Every hart rewrites and then runs a small function on a code page of
+ * its own, so that each write invalidates the translated block of that
+ * page.  Hart 0 reports the rate of rewrites over all harts, which shows
+ * how TB invalidation scales with the number of vCPUs when run with
+ * different -smp values.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <stdint.h>
+
+#define MAX_HARTS   64
+#define PAGE_SIZE   4096
+#define STACK_SIZE  4096
+#define ITERATIONS  20000
+
+/* mtime of the CLINT of the virt machine, which counts at 10 MHz */
+#define MTIME       ((volatile uint64_t *)0x0200bff8)
+#define MTIME_FREQ  10000000
+
+#define SYS_WRITE0          0x04
+#define SYS_EXIT_EXTENDED   0x20
+
+uint8_t stacks[MAX_HARTS][STACK_SIZE] __attribute__((aligned(16)));
+static uint32_t code[MAX_HARTS][PAGE_SIZE / 4]
+    __attribute__((aligned(PAGE_SIZE)));
+static uint32_t arrived, finished, nr_harts, failed;
+
+/*
+ * Each hart starts here in M-mode, with its hart id in a0.  This is built
+ * with -fno-toplevel-reorder, so that it is placed first.
+ */
+asm(".text\n"
+    ".global _start\n"
+    "_start:\n"
+    "    li    t0, 64\n"
+    "    bgeu  a0, t0, 1f\n"
+    "    addi  t0, a0, 1\n"
+    "    slli  t0, t0, 12\n"
+    "    lla   sp, stacks\n"
+    "    add   sp, sp, t0\n"
+    "    j     hart_main\n"
+    "1:  wfi\n"
+    "    j     1b\n");
+
+/* After _start, which must be the first code in RAM */
+#include "semicall.h"
+
+static void print_str(const char *s)
+{
+    __semi_call(SYS_WRITE0, (uintptr_t)s);
+}
+
+static void print_num(uint64_t n)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf) - 1;
+
+    *p = 0;
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    print_str(p);
+}
+
+static void __attribute__((noreturn)) exit_test(uint64_t status)
+{
+    static uint64_t args[2];
+
+    args[0] = 0x20026;      /* ADP_Stopped_ApplicationExit */
+    args[1] = status;
+    __semi_call(SYS_EXIT_EXTENDED, (uintptr_t)args);
+    for (;;) {
+        asm volatile("wfi");
+    }
+}
+
+/* Rewrite "li a0, imm; ret" on the page of @hart, and run it. */
+static void run_code(unsigned int hart)
+{
+    int (*fn)(void) = (int (*)(void))code[hart];
+
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        uint32_t imm = i & 0x7ff;
+
+        code[hart][0] = (imm << 20) | (10 << 7) | 0x13;     /* addi a0 */
+        code[hart][1] = 0x00008067;                         /* ret */
+        asm volatile("fence.i" ::: "memory");
+        if (fn() != imm) {
+            __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void __attribute__((noreturn)) hart_main(unsigned int hart)
+{
+    uint64_t start, ticks, us;
+    unsigned int n;
+
+    __atomic_add_fetch(&arrived, 1, __ATOMIC_SEQ_CST);
+    if (hart != 0) {
+        while (!__atomic_load_n(&nr_harts, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        run_code(hart);
+        __atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+        for (;;) {
+            asm volatile("wfi");
+        }
+    }
+
+    /* All harts start together; give them 100ms to check in. */
+    start = *MTIME;
+    while (*MTIME - start < MTIME_FREQ / 10) {
+        continue;
+    }
+    n = __atomic_load_n(&arrived, __ATOMIC_SEQ_CST);
+
+    start = *MTIME;
+    __atomic_store_n(&nr_harts, n, __ATOMIC_RELEASE);
+    run_code(0);
+    while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < n - 1) {
+        continue;
+    }
+    ticks = *MTIME - start;
+    us = ticks / (MTIME_FREQ / 1000000);
+
+    print_str("smc-bench: ");
+    print_num(n);
+    print_str(" harts, ");
+    print_num((uint64_t)n * ITERATIONS);
+    print_str(" rewrites in ");
+    print_num(us);
+    print_str(" us, ");
+    print_num(us ? (uint64_t)n * ITERATIONS * 1000000 / us : 0);
+    print_str(" rewrites/s\n");
+
+    exit_test(__atomic_load_n(&failed, __ATOMIC_RELAXED));
+}
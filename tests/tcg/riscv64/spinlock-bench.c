@@ -0,0 +1,108 @@
+/*
+ * Spinlock throughput versus thread count
+ *
+ * Each thread takes a lock, increments a shared counter and releases
+ * the lock, for a fixed number of iterations.  The lock is taken either
+ * with an LR/SC loop or with AMOSWAP, and released the way Linux does
+ * it, with a FENCE RW,W before a plain store.
+ *
+ * Usage: spinlock-bench [max-threads [iterations]]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int lock;
+static unsigned long counter;
+static unsigned long iterations = 20000;
+static pthread_barrier_t start;
+
+static void lock_lrsc(int *p)
+{
+    int tmp;
+
+    asm volatile("1: lr.w.aq %0, (%1)\n"
+                 "   bnez %0, 1b\n"
+                 "   sc.w %0, %2, (%1)\n"
+                 "   bnez %0, 1b\n"
+                 : "=&r"(tmp) : "r"(p), "r"(1) : "memory");
+}
+
+static void lock_amo(int *p)
+{
+    int old;
+
+    do {
+        asm volatile("amoswap.w.aq %0, %2, (%1)"
+                     : "=r"(old) : "r"(p), "r"(1) : "memory");
+    } while (old);
+}
+
+static void unlock(int *p)
+{
+    asm volatile("fence rw, w\n"
+                 "sw zero, 0(%0)"
+                 : : "r"(p) : "memory");
+}
+
+static void *worker(void *arg)
+{
+    void (*lock_fn)(int *) = arg;
+
+    pthread_barrier_wait(&start);
+    for (unsigned long i = 0; i < iterations; i++) {
+        lock_fn(&lock);
+        counter++;
+        unlock(&lock);
+    }
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *name, void (*lock_fn)(int *), int nthreads)
+{
+    pthread_t threads[nthreads];
+    double t;
+
+    counter = 0;
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_create(&threads[i], NULL, worker, lock_fn);
+    }
+    t = now();
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    t = now() - t;
+    pthread_barrier_destroy(&start);
+
+    assert(counter == iterations * nthreads);
+    printf("%-6s %3d threads: %12.0f locks/s\n",
+           name, nthreads, counter / t);
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : 4;
+
+    if (argc > 2) {
+        iterations = strtoul(argv[2], NULL, 0);
+    }
+    for (int n = 1; n <= max_threads; n *= 2) {
+        run("lr/sc", lock_lrsc, n);
+        run("amo", lock_amo, n);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Vector memcpy throughput
+ *
+ * Copies buffers of various sizes with unit-stride vector loads and
+ * stores of each element width, then with a masked copy that only
+ * writes the even bytes.  The source and destination are misaligned so
+ * that elements straddle page boundaries, and every copy is checked.
+ *
+ * Usage: vmemcpy-bench [iterations]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SIZE (1 << 18)
+
+static unsigned long iterations = 20;
+static uint8_t src[MAX_SIZE + 64];
+static uint8_t dst[MAX_SIZE + 64];
+
+/* Vector registers and CSRs written by the copy loops */
+#define CLOBBER_V0_V7   "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7"
+#define CLOBBER_V8_V15  "v8", "v9", "v10", "v11", "v12", "v13", "v14", "v15"
+#define CLOBBER_VCFG    "vl", "vtype"
+
+static void copy_e8(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t vl;
+
+    for (; n; n -= vl, s += vl, d += vl) {
+        asm volatile("vsetvli %0, %1, e8, m8, ta, ma\n"
+                     "vle8.v v0, (%2)\n"
+                     "vse8.v v0, (%3)"
+                     : "=&r"(vl) : "r"(n), "r"(s), "r"(d) :
+                     CLOBBER_V0_V7, CLOBBER_VCFG, "memory");
+    }
+}
+
+static void copy_e16(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t vl;
+
+    for (n /= 2; n; n -= vl, s += vl * 2, d += vl * 2) {
+        asm volatile("vsetvli %0, %1, e16, m8, ta, ma\n"
+                     "vle16.v v0, (%2)\n"
+                     "vse16.v v0, (%3)"
+                     : "=&r"(vl) : "r"(n), "r"(s), "r"(d) :
+                     CLOBBER_V0_V7, CLOBBER_VCFG, "memory");
+    }
+}
+
+static void copy_e32(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t vl;
+
+    for (n /= 4; n; n -= vl, s += vl * 4, d += vl * 4) {
+        asm volatile("vsetvli %0, %1, e32, m8, ta, ma\n"
+                     "vle32.v v0, (%2)\n"
+                     "vse32.v v0, (%3)"
+                     : "=&r"(vl) : "r"(n), "r"(s), "r"(d) :
+                     CLOBBER_V0_V7, CLOBBER_VCFG, "memory");
+    }
+}
+
+static void copy_e64(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t vl;
+
+    for (n /= 8; n; n -= vl, s += vl * 8, d += vl * 8) {
+        asm volatile("vsetvli %0, %1, e64, m8, ta, ma\n"
+                     "vle64.v v8, (%2)\n"
+                     "vse64.v v8, (%3)"
+                     : "=&r"(vl) : "r"(n), "r"(s), "r"(d) :
+                     CLOBBER_V8_V15, CLOBBER_VCFG, "memory");
+    }
+}
+
+/* Copy the even bytes only, under a mask of alternating bits. */
+static void copy_even(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t vl;
+
+    for (; n; n -= vl, s += vl, d += vl) {
+        asm volatile("vsetvli %0, %1, e8, m4, ta, mu\n"
+                     "vid.v v8\n"
+                     "vand.vi v8, v8, 1\n"
+                     "vmseq.vi v0, v8, 0\n"
+                     "vle8.v v8, (%2), v0.t\n"
+                     "vse8.v v8, (%3), v0.t"
+                     : "=&r"(vl) : "r"(n), "r"(s), "r"(d) :
+                     "v0", "v8", "v9", "v10", "v11", CLOBBER_VCFG, "memory");
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *name, void (*copy)(uint8_t *, const uint8_t *,
+                                                size_t),
+                size_t size, bool even_only)
+{
+    uint8_t *s = src + 3, *d = dst + 5;
+    double t;
+
+    memset(dst, 0, sizeof(dst));
+    t = now();
+    for (unsigned long i = 0; i < iterations; i++) {
+        copy(d, s, size);
+    }
+    t = now() - t;
+
+    for (size_t i = 0; i < size; i++) {
+        assert(d[i] == (even_only && (i & 1) ? 0 : s[i]));
+    }
+    assert(d[-1] == 0 && d[size] == 0);
+    printf("%-5s %8zu bytes: %10.1f MB/s\n",
+           name, size, size * iterations / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = i * 7 + 1;
+    }
+    for (size_t size = 64; size <= MAX_SIZE; size *= 16) {
+        run("e8", copy_e8, size, false);
+        run("e16", copy_e16, size, false);
+        run("e32", copy_e32, size, false);
+        run("e64", copy_e64, size, false);
+        run("mask", copy_even, size, true);
+    }
+    return 0;
+}
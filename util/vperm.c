@@ -0,0 +1,491 @@
+/*
+ * Element permutations for vector instruction helpers
+ *
+ * Segment loads and stores, gathers and compresses are the operations
+ * of guest vector ISAs that the element-wise GVEC expanders do not
+ * cover.  The portable versions below move one element at a time; on
+ * x86 hosts the common cases are done with SSSE3 shuffles and AVX2
+ * gathers instead.  As in bufferiszero.c, the implementation is chosen
+ * at startup from the CPUID bits, and test_vperm_next_accel lets the
+ * tests go through all of them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/vperm.h"
+
+static inline uint64_t ld_elem(const void *p, unsigned esz)
+{
+    switch (esz) {
+    case 1:
+        return ldub_p(p);
+    case 2:
+        return lduw_he_p(p);
+    case 4:
+        return ldl_he_p(p);
+    default:
+        return ldq_he_p(p);
+    }
+}
+
+static inline void st_elem(void *p, unsigned esz, uint64_t val)
+{
+    switch (esz) {
+    case 1:
+        stb_p(p, val);
+        break;
+    case 2:
+        stw_he_p(p, val);
+        break;
+    case 4:
+        stl_he_p(p, val);
+        break;
+    default:
+        stq_he_p(p, val);
+        break;
+    }
+}
+
+/*
+ * The portable versions are inlined once per element size, so that
+ * each element is moved with a single load and store.
+ */
+#define VPERM_FOR_ESZ(ESZ, FN, ...)         \
+    do {                                    \
+        switch (ESZ) {                      \
+        case 1:                             \
+            FN(__VA_ARGS__, 1);             \
+            break;                          \
+        case 2:                             \
+            FN(__VA_ARGS__, 2);             \
+            break;                          \
+        case 4:                             \
+            FN(__VA_ARGS__, 4);             \
+            break;                          \
+        case 8:                             \
+            FN(__VA_ARGS__, 8);             \
+            break;                          \
+        default:                            \
+            g_assert_not_reached();         \
+        }                                   \
+    } while (0)
+
+static inline void deinterleave_esz(void *dst, size_t stride,
+                                    const void *src, unsigned nf,
+                                    size_t n, unsigned esz)
+{
+    size_t i;
+    unsigned k;
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < nf; k++) {
+            st_elem(dst + k * stride + i * esz, esz,
+                    ld_elem(src + (i * nf + k) * esz, esz));
+        }
+    }
+}
+
+static void vperm_deinterleave_int(void *dst, size_t stride,
+                                   const void *src, unsigned nf,
+                                   unsigned esz, size_t n)
+{
+    VPERM_FOR_ESZ(esz, deinterleave_esz, dst, stride, src, nf, n);
+}
+
+static inline void interleave_esz(void *dst, const void *src,
+                                  size_t stride, unsigned nf,
+                                  size_t n, unsigned esz)
+{
+    size_t i;
+    unsigned k;
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < nf; k++) {
+            st_elem(dst + (i * nf + k) * esz, esz,
+                    ld_elem(src + k * stride + i * esz, esz));
+        }
+    }
+}
+
+static void vperm_interleave_int(void *dst, const void *src, size_t stride,
+                                 unsigned nf, unsigned esz, size_t n)
+{
+    VPERM_FOR_ESZ(esz, interleave_esz, dst, src, stride, nf, n);
+}
+
+static inline void gather_esz(void *dst, const void *src, const void *idx,
+                              size_t n, uint64_t limit, unsigned esz)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint64_t index = ld_elem(idx + i * esz, esz);
+
+        st_elem(dst + i * esz, esz,
+                index < limit ? ld_elem(src + index * esz, esz) : 0);
+    }
+}
+
+static void vperm_gather_int(void *dst, const void *src, const void *idx,
+                             unsigned esz, size_t n, uint64_t limit)
+{
+    VPERM_FOR_ESZ(esz, gather_esz, dst, src, idx, n, limit);
+}
+
+static inline void compress_esz(void *dst, size_t *k, const void *src,
+                                const uint64_t *mask, size_t i, size_t n,
+                                unsigned esz)
+{
+    for (; i < n; i++) {
+        if (mask[i / 64] & (1ull << (i % 64))) {
+            st_elem(dst + (*k)++ * esz, esz, ld_elem(src + i * esz, esz));
+        }
+    }
+}
+
+/* Copy the elements from @i on, to @dst from element @k on. */
+static size_t compress_from(void *dst, size_t k, const void *src,
+                            const uint64_t *mask, size_t i, size_t n,
+                            unsigned esz)
+{
+    VPERM_FOR_ESZ(esz, compress_esz, dst, &k, src, mask, i, n);
+    return k;
+}
+
+static size_t vperm_compress_int(void *dst, const void *src,
+                                 const uint64_t *mask, unsigned esz,
+                                 size_t n)
+{
+    return compress_from(dst, 0, src, mask, 0, n, esz);
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include <immintrin.h>
+
+static void __attribute__((target("ssse3")))
+vperm_deinterleave_ssse3(void *dst, size_t stride, const void *src,
+                         unsigned nf, unsigned esz, size_t n)
+{
+    size_t i = 0;
+
+    if (nf == 2 && esz <= 4) {
+        /* Each 16 bytes hold 8 bytes of each of the two fields. */
+        size_t step = 8 / esz;
+        __m128i shuf =
+            esz == 1 ? _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                     1, 3, 5, 7, 9, 11, 13, 15) :
+            esz == 2 ? _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+                                     2, 3, 6, 7, 10, 11, 14, 15) :
+                       _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11,
+                                     4, 5, 6, 7, 12, 13, 14, 15);
+
+        for (; i + step <= n; i += step) {
+            __m128i x = _mm_loadu_si128(src + i * 2 * esz);
+
+            x = _mm_shuffle_epi8(x, shuf);
+            _mm_storel_epi64(dst + i * esz, x);
+            _mm_storel_epi64(dst + stride + i * esz,
+                             _mm_unpackhi_epi64(x, x));
+        }
+    } else if (nf == 4 && esz == 1) {
+        /* Each 16 bytes hold 4 bytes of each of the four fields. */
+        __m128i shuf = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                     2, 6, 10, 14, 3, 7, 11, 15);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128(src + i * 4);
+
+            x = _mm_shuffle_epi8(x, shuf);
+            stl_he_p(dst + i, _mm_cvtsi128_si32(x));
+            stl_he_p(dst + stride + i,
+                     _mm_cvtsi128_si32(_mm_srli_si128(x, 4)));
+            stl_he_p(dst + 2 * stride + i,
+                     _mm_cvtsi128_si32(_mm_srli_si128(x, 8)));
+            stl_he_p(dst + 3 * stride + i,
+                     _mm_cvtsi128_si32(_mm_srli_si128(x, 12)));
+        }
+    }
+    vperm_deinterleave_int(dst + i * esz, stride, src + i * nf * esz,
+                           nf, esz, n - i);
+}
+
+static void __attribute__((target("ssse3")))
+vperm_interleave_ssse3(void *dst, const void *src, size_t stride,
+                       unsigned nf, unsigned esz, size_t n)
+{
+    size_t i = 0;
+
+    if (nf == 2 && esz <= 4) {
+        size_t step = 8 / esz;
+
+        for (; i + step <= n; i += step) {
+            __m128i a = _mm_loadl_epi64(src + i * esz);
+            __m128i b = _mm_loadl_epi64(src + stride + i * esz);
+            __m128i x = esz == 1 ? _mm_unpacklo_epi8(a, b) :
+                        esz == 2 ? _mm_unpacklo_epi16(a, b) :
+                                   _mm_unpacklo_epi32(a, b);
+
+            _mm_storeu_si128(dst + i * 2 * esz, x);
+        }
+    } else if (nf == 4 && esz == 1) {
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_cvtsi32_si128(ldl_he_p(src + i));
+            __m128i b = _mm_cvtsi32_si128(ldl_he_p(src + stride + i));
+            __m128i c = _mm_cvtsi32_si128(ldl_he_p(src + 2 * stride + i));
+            __m128i d = _mm_cvtsi32_si128(ldl_he_p(src + 3 * stride + i));
+
+            _mm_storeu_si128(dst + i * 4,
+                             _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b),
+                                                _mm_unpacklo_epi8(c, d)));
+        }
+    }
+    vperm_interleave_int(dst + i * nf * esz, src + i * esz, stride,
+                         nf, esz, n - i);
+}
+
+static void __attribute__((target("ssse3")))
+vperm_gather_ssse3(void *dst, const void *src, const void *idx,
+                   unsigned esz, size_t n, uint64_t limit)
+{
+    size_t i = 0;
+
+    if (esz == 1 && limit <= 16) {
+        /* The whole source fits in one register: use it as a table. */
+        uint8_t buf[16] = { };
+        __m128i table, max;
+
+        memcpy(buf, src, limit);
+        table = _mm_loadu_si128((__m128i *)buf);
+        max = _mm_set1_epi8(limit - 1);
+        for (; limit && i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128(idx + i);
+            __m128i ok = _mm_cmpeq_epi8(_mm_min_epu8(x, max), x);
+
+            _mm_storeu_si128(dst + i,
+                             _mm_and_si128(_mm_shuffle_epi8(table, x), ok));
+        }
+    }
+    vperm_gather_int(dst + i * esz, src, idx + i * esz, esz, n - i, limit);
+}
+
+static void __attribute__((target("avx2")))
+vperm_gather_avx2(void *dst, const void *src, const void *idx,
+                  unsigned esz, size_t n, uint64_t limit)
+{
+    size_t i = 0;
+
+    /*
+     * The indexes are unsigned but the gathers take them as signed:
+     * those with the sign bit set are out of range as well.
+     */
+    if (esz == 4 && limit <= INT32_MAX) {
+        __m256i lim = _mm256_set1_epi32(limit);
+        __m256i neg = _mm256_set1_epi32(-1);
+
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256(idx + i * 4);
+            __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi32(lim, x),
+                                          _mm256_cmpgt_epi32(x, neg));
+
+            _mm256_storeu_si256(dst + i * 4,
+                                _mm256_mask_i32gather_epi32(
+                                    _mm256_setzero_si256(), src, x, ok, 4));
+        }
+    } else if (esz == 8 && limit <= INT64_MAX) {
+        __m256i lim = _mm256_set1_epi64x(limit);
+        __m256i neg = _mm256_set1_epi64x(-1);
+
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(idx + i * 8);
+            __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi64(lim, x),
+                                          _mm256_cmpgt_epi64(x, neg));
+
+            _mm256_storeu_si256(dst + i * 8,
+                                _mm256_mask_i64gather_epi64(
+                                    _mm256_setzero_si256(), src, x, ok, 8));
+        }
+    } else {
+        vperm_gather_ssse3(dst, src, idx, esz, n, limit);
+        return;
+    }
+    vperm_gather_int(dst + i * esz, src, idx + i * esz, esz, n - i, limit);
+}
+
+/*
+ * Shuffles that pack the bytes, or the 16-bit elements, whose bit is set
+ * in the index at the start of a register.
+ */
+static uint8_t compress_shuf8[256][16];
+static uint8_t compress_shuf16[256][16];
+
+static void init_compress_shuf(void)
+{
+    unsigned m, j, k;
+
+    for (m = 0; m < 256; m++) {
+        memset(compress_shuf8[m], 0x80, 16);
+        memset(compress_shuf16[m], 0x80, 16);
+        for (j = k = 0; j < 8; j++) {
+            if (m & (1 << j)) {
+                compress_shuf8[m][k] = j;
+                compress_shuf16[m][2 * k] = 2 * j;
+                compress_shuf16[m][2 * k + 1] = 2 * j + 1;
+                k++;
+            }
+        }
+    }
+}
+
+static size_t __attribute__((target("ssse3")))
+vperm_compress_ssse3(void *dst, const void *src, const uint64_t *mask,
+                     unsigned esz, size_t n)
+{
+    size_t total = 0, i, k = 0;
+
+    if (esz > 2) {
+        return vperm_compress_int(dst, src, mask, esz, n);
+    }
+
+    /*
+     * Each step stores 8 elements but keeps only the selected ones:
+     * stop before the stores could reach past the last element copied.
+     */
+    for (i = 0; i + 64 <= n; i += 64) {
+        total += ctpop64(mask[i / 64]);
+    }
+    if (i < n) {
+        total += ctpop64(mask[i / 64] & MAKE_64BIT_MASK(0, n - i));
+    }
+
+    for (i = 0; i + 8 <= n && k + 8 <= total; i += 8) {
+        unsigned m = (mask[i / 64] >> (i % 64)) & 0xff;
+
+        if (esz == 1) {
+            __m128i x = _mm_loadl_epi64(src + i);
+            __m128i shuf = _mm_loadu_si128((__m128i *)compress_shuf8[m]);
+
+            _mm_storel_epi64(dst + k, _mm_shuffle_epi8(x, shuf));
+        } else {
+            __m128i x = _mm_loadu_si128(src + i * 2);
+            __m128i shuf = _mm_loadu_si128((__m128i *)compress_shuf16[m]);
+
+            _mm_storeu_si128(dst + k * 2, _mm_shuffle_epi8(x, shuf));
+        }
+        k += ctpop8(m);
+    }
+    return compress_from(dst, k, src, mask, i, n, esz);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+/*
+ * Note that for test_vperm_next_accel, the most preferred ISA must have
+ * the least significant bit.
+ */
+#define CACHE_AVX2    1
+#define CACHE_SSSE3   2
+
+static unsigned cpuid_cache;
+
+static void (*deinterleave_accel)(void *, size_t, const void *,
+                                  unsigned, unsigned, size_t) =
+    vperm_deinterleave_int;
+static void (*interleave_accel)(void *, const void *, size_t,
+                                unsigned, unsigned, size_t) =
+    vperm_interleave_int;
+static void (*gather_accel)(void *, const void *, const void *,
+                            unsigned, size_t, uint64_t) = vperm_gather_int;
+static size_t (*compress_accel)(void *, const void *, const uint64_t *,
+                                unsigned, size_t) = vperm_compress_int;
+
+static void init_accel(unsigned cache)
+{
+    deinterleave_accel = vperm_deinterleave_int;
+    interleave_accel = vperm_interleave_int;
+    gather_accel = vperm_gather_int;
+    compress_accel = vperm_compress_int;
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_SSSE3) {
+        deinterleave_accel = vperm_deinterleave_ssse3;
+        interleave_accel = vperm_interleave_ssse3;
+        gather_accel = vperm_gather_ssse3;
+        compress_accel = vperm_compress_ssse3;
+    }
+    if (cache & CACHE_AVX2) {
+        gather_accel = vperm_gather_avx2;
+    }
+#endif
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (c & bit_SSSE3) {
+            cache |= CACHE_SSSE3;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    init_compress_shuf();
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_vperm_next_accel(void)
+{
+    /*
+     * If no bits set, we just tested the portable versions, and there
+     * are no more acceleration options to test.
+     */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+void vperm_deinterleave(void *dst, size_t stride, const void *src,
+                        unsigned nf, unsigned esz, size_t n)
+{
+    deinterleave_accel(dst, stride, src, nf, esz, n);
+}
+
+void vperm_interleave(void *dst, const void *src, size_t stride,
+                      unsigned nf, unsigned esz, size_t n)
+{
+    interleave_accel(dst, src, stride, nf, esz, n);
+}
+
+void vperm_gather(void *dst, const void *src, const void *idx,
+                  unsigned esz, size_t n, uint64_t limit)
+{
+    gather_accel(dst, src, idx, esz, n, limit);
+}
+
+size_t vperm_compress(void *dst, const void *src, const uint64_t *mask,
+                      unsigned esz, size_t n)
+{
+    return compress_accel(dst, src, mask, esz, n);
+}